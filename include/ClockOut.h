@@ -0,0 +1,52 @@
+#ifndef CLOCK_OUT_H
+#define CLOCK_OUT_H
+
+#include <Arduino.h>
+#include "driver/timer.h"
+#include <PulseSchedule.h>
+
+#define CLOCK_OUT_WIDTH_US 5000
+#define CLOCK_OUT_DEFAULT_PPQN 4
+#define CLOCK_OUT_TIMER_GROUP TIMER_GROUP_1
+#define CLOCK_OUT_TIMER TIMER_0
+#define CLOCK_OUT_MIN_LEAD_US 2 // edges due sooner are set right away instead of by the alarm
+
+// Clock output pin driven from a PulseSchedule by a hardware timer alarm. The
+// timer counts microseconds on the esp_timer timebase and its interrupt sets
+// the pin at the rise and fall deadlines, so the edges never wait for a task.
+// The pulse on a step start is armed a step ahead from the StepClock deadline,
+// it is due before the step callback runs. onStep() comes from the StepClock
+// callbacks, the rest from the sequencer task; the interrupt shares the
+// schedule with them under a spinlock.
+class ClockOut
+{
+public:
+  ClockOut();
+
+  bool begin(int pin);
+  // Pulses per quarter note (0, 1, 2, 4 or 24), from any task. Applies at the next beat.
+  void setRate(uint8_t ppqn) { schedule.setRate(ppqn); }
+
+  // esp_timer task only. nextDeadline is the step after this one. Without
+  // running no pulses are sent and the next step starts a beat.
+  void onStep(int64_t deadline, int64_t nextDeadline, uint64_t stepPeriod, uint8_t stepsPerBeat, bool running);
+  // Sequencer task, after applying commands. Playing: arms the first pulse of
+  // the first step at nextDeadline. Stopped: no more rising edges.
+  void setRunning(bool running, int64_t nextDeadline, uint64_t stepPeriod, uint8_t stepsPerBeat);
+  // Sequencer task, after StepClock::align() moved the next step
+  void moveNextStep(int64_t nextDeadline);
+  uint32_t pulses() const { return schedule.pulses(); }
+
+private:
+  static bool IRAM_ATTR onAlarm(void *arg);
+  // Sets the edges that are due and arms the alarm for the next one, mux held
+  void update();
+  void write(bool high);
+
+  int pin;
+  bool started;
+  portMUX_TYPE mux;
+  PulseSchedule schedule;
+};
+
+#endif
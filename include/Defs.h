@@ -1,57 +1,19 @@
-// mV table definition
-#define NOTE_C1 100
-#define NOTE_CS1 183
-#define NOTE_D1 267
-#define NOTE_DS1 350
-#define NOTE_E1 433
-#define NOTE_F1 517
-#define NOTE_FS1 600
-#define NOTE_G1 683
-#define NOTE_GS1 767
-#define NOTE_A1 850
-#define NOTE_AS1 933
-#define NOTE_B1 1017
-#define NOTE_C2 1100
-#define NOTE_CS2 1183
-#define NOTE_D2 1267
-#define NOTE_DS2 1350
-#define NOTE_E2 1433
-#define NOTE_F2 1517
-#define NOTE_FS2 1600
-#define NOTE_G2 1683
-#define NOTE_GS2 1767
-#define NOTE_A2 1850
-#define NOTE_AS2 1933
-#define NOTE_B2 2017
-#define NOTE_C3 2100
-#define NOTE_CS3 2183
-#define NOTE_D3 2267
-#define NOTE_DS3 2350
-#define NOTE_E3 2433
-#define NOTE_F3 2517
-#define NOTE_FS3 2600
-#define NOTE_G3 2683
-#define NOTE_GS3 2767
-#define NOTE_A3 2850
-#define NOTE_AS3 2933
-#define NOTE_B3 3017
-#define NOTE_C4 3100
-#define NOTE_CS4 3183
-#define NOTE_D4 3267
-#define NOTE_DS4 3350
-#define NOTE_E4 3433
-#define NOTE_F4 3517
-#define NOTE_FS4 3600
-#define NOTE_G4 3683
-#define NOTE_GS4 3767
-#define NOTE_A4 3850
-#define NOTE_AS4 3933
-#define NOTE_B4 4017
-#define NOTE_C5 4100
-
 #define MAX_STEPS 16
 
+// Pins
+#define SQUARE_GATE_PIN 2     // HIGH-LOW
+#define SUB_SEQ_PIN 4         // HIGH-LOW
+#define ANALOG_DIGITAL_PIN 13 // HIGH-LOW
+#define GATE_PIN 27
+#define FREQUENCY_PIN 19
+#define CLOCK_IN_PIN 35 // external clock, input only pin
+#define RESET_IN_PIN 39 // external reset, input only pin
+#define CLOCK_OUT_PIN 26
+#define SD_CS_PIN 5 // SD card on the VSPI pins, only with SAMPLE_ON_SD
+
+#define BLE_MTU 247 // a single write carries up to BLE_MTU - 3 bytes
 #define MSG_LENGTH 3
+#define FRAME_HEADER_LENGTH 2 // opcode + payload length, for variable length opcodes
 
 // OP CODES
 
@@ -60,6 +22,34 @@
 #define OP_Step 3
 #define OP_Note 4
 #define OP_Route 5
+#define OP_NoteBack 6 // like OP_Note but edits the back pattern buffer
+#define OP_Commit 7   // swaps front/back pattern, data 1 = CommitStep/CommitBar
+#define OP_Pattern 8  // variable length: OP_Pattern, payload length, start step, flags, notes...
+#define OP_Status 9   // device -> app: MTU (2 bytes LE), conn interval in 1.25 ms units (2 bytes LE), slave latency
+#define OP_Calibrate 10 // app -> device: start VCO calibration. device -> app: notes reached, points measured
+#define OP_TempoFine 11 // tempo in 1/100 BPM, 2 bytes LE. Sent back with OP_Tempo on every tempo change
+#define OP_Clock 12 // app -> device: data 1 = ClockInternal/ClockExternal/ClockMidi.
+                    // device -> app: locked, phase error in us (int16 LE), followed tempo in 1/100 BPM (2 bytes LE)
+#define OP_ClockOut 13 // data 1 = pulses per quarter note on CLOCK_OUT_PIN: 0 (off), 1, 2, 4 or 24
+#define OP_Sync 14 // app -> device: data 1 = sequence number. device -> app, on its own: sequence number,
+                   // device us at arrival and at the connection event the reply goes out on
+                   // (4 bytes LE each), for an NTP style offset
+#define OP_At 15   // variable length: OP_At, 7, device us (4 bytes LE), one 3-byte message to apply at that time.
+                   // device -> app: late commands (saturating), residual us (int16 LE), lead ms (uint16 LE)
+#define OP_Ping 16 // app -> device: data 1 = sequence number. device -> app, on its own: sequence number,
+                   // us from arrival to reply (4 bytes LE), i.e. the command path without the radio
+#define OP_Latency 17 // app -> device: data 1 = LatencyReport/LatencyReset/LatencyOff/LatencyOn.
+                      // device -> app: samples, max us (4 bytes LE), one count per LatencyHistogram bucket
+#define OP_Audio 18 // app -> device: data 1 = AudioReport/AudioReset, or a setting and data 2 its value:
+                    // AudioBlockSize (frames), AudioDmaBuffers (count), AudioDmaFrames (frames per buffer / 8),
+                    // AudioInterpolation (InterpolateNearest/InterpolateLinear/InterpolateHermite).
+                    // device -> app: block frames, DMA buffers, DMA frames / 8, underruns, late blocks
+                    // (4 bytes LE each), longest block us (2 bytes LE, saturating), interpolation
+
+#define AT_PAYLOAD_LENGTH 7
+
+#define TEMPO_MIN_CENTI 100   // 1.00 BPM
+#define TEMPO_MAX_CENTI 30000 // 300.00 BPM
 
 // Data 1
 
@@ -72,6 +62,28 @@
 #define Seq 6
 #define A_out 7
 #define D_out 8
+#define CommitStep 0
+#define CommitBar 1
+#define ClockInternal 0
+#define ClockExternal 1
+#define ClockMidi 2
+#define LatencyReport 0
+#define LatencyReset 1
+#define LatencyOff 2 // pings are ignored
+#define LatencyOn 3
+#define AudioReport 0
+#define AudioReset 1 // zeroes the counters
+#define AudioBlockSize 2
+#define AudioDmaBuffers 3
+#define AudioDmaFrames 4
+#define AudioInterpolation 5 // how the sample voices are repitched, data 2:
+#define InterpolateNearest 0
+#define InterpolateLinear 1
+#define InterpolateHermite 2
+
+// OP_Pattern flags
+#define PatternCommit 0x01 // commit after loading
+#define PatternAtBar 0x02  // with PatternCommit, wait for the bar start
 
 // Data 2
 
@@ -0,0 +1,34 @@
+#ifndef EXTERNAL_CLOCK_H
+#define EXTERNAL_CLOCK_H
+
+#include <Arduino.h>
+#include <SpscQueue.h>
+
+#define CLOCK_PULSE_QUEUE 16
+
+// Clock and reset inputs. The rising edge ISRs only take an esp_timer
+// timestamp and wake a task with the given notification bits, the PLL runs
+// there (see ClockFollower).
+class ExternalClock
+{
+public:
+  ExternalClock();
+
+  bool begin(int clockPin, int resetPin, TaskHandle_t task, uint32_t pulseBits, uint32_t resetBits);
+
+  // Pulse timestamps in us since boot, oldest first
+  bool nextPulse(int64_t &at) { return pulses.pop(at); }
+  uint32_t droppedPulses() const { return dropped; }
+
+private:
+  static void IRAM_ATTR onClock(void *arg);
+  static void IRAM_ATTR onReset(void *arg);
+
+  SpscQueue<int64_t, CLOCK_PULSE_QUEUE> pulses; // ISR -> task
+  volatile uint32_t dropped;
+  TaskHandle_t task;
+  uint32_t pulseBits;
+  uint32_t resetBits;
+};
+
+#endif
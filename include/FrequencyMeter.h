@@ -0,0 +1,35 @@
+#ifndef FREQUENCY_METER_H
+#define FREQUENCY_METER_H
+
+#include <Arduino.h>
+#include "driver/mcpwm.h"
+#include <FrequencyEstimator.h>
+
+#define FREQ_CAPTURE_CLOCK 80000000 // MCPWM capture timer runs from the APB clock
+#define FREQ_WINDOW_TICKS (FREQ_CAPTURE_CLOCK / 10) // publish at least every 100 ms
+#define FREQ_MAX_CYCLES 256
+#define FREQ_TIMEOUT_MS 5000 // no edge for this long reads as 0 Hz (lowest readable: 0.2 Hz)
+
+// Rising edges on the input pin are timestamped by the MCPWM capture unit in
+// hardware, the ISR only feeds the timestamp to a FrequencyEstimator.
+class FrequencyMeter
+{
+public:
+  FrequencyMeter();
+
+  bool begin(int pin);
+  // Hz, 0 if the signal stopped
+  float read();
+  // Changes every time a new average is published
+  uint32_t updates() const { return estimator.updates(); }
+
+private:
+  static bool IRAM_ATTR onCapture(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel,
+                                  const cap_event_data_t *edata, void *arg);
+
+  FrequencyEstimator estimator;
+  uint32_t lastUpdates;
+  unsigned long lastUpdateMs;
+};
+
+#endif
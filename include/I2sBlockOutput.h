@@ -0,0 +1,49 @@
+#ifndef I2S_BLOCK_OUTPUT_H
+#define I2S_BLOCK_OUTPUT_H
+
+#include <Arduino.h>
+#include "driver/i2s.h"
+#include <AudioPipeline.h>
+
+#define I2S_DMA_BUFFERS_MIN 2
+#define I2S_DMA_BUFFERS_MAX 32
+#define I2S_DMA_FRAMES_MIN 8
+#define I2S_DMA_FRAMES_MAX 1024
+#define I2S_DMA_DEFAULT_BUFFERS 8 // what AudioOutputI2S used
+#define I2S_DMA_DEFAULT_FRAMES 64
+#define I2S_WRITE_TIMEOUT_MS 100
+
+// Pipeline output on the I2S DAC, mono duplicated to both channels.
+// The DMA buffers are the latency/safety trade-off: buffers * frames is the
+// audio queued ahead of the pipeline (latency), and the longest the audio
+// task can be held up before the output runs dry (safety). On underrun the
+// driver plays silence instead of repeating the last buffers.
+class I2sBlockOutput : public AudioBlockSink
+{
+public:
+  I2sBlockOutput(int bclkPin, int wclkPin, int doutPin, i2s_port_t port = I2S_NUM_0);
+
+  // Installs the driver, or reinstalls it with new settings. Audio task only.
+  bool begin(uint32_t sampleRate, uint8_t dmaBuffers, uint16_t dmaFrames);
+  void end();
+  bool running() const { return installed; }
+
+  size_t write(const int16_t *block, size_t frames) override;
+  uint32_t capacity() const override { return (uint32_t)buffers * frames; }
+  uint32_t bufferFrames() const override { return frames; }
+
+  uint8_t dmaBuffers() const { return buffers; }
+  uint16_t dmaFrames() const { return frames; }
+
+private:
+  i2s_port_t port;
+  int bclk;
+  int wclk;
+  int dout;
+  bool installed;
+  uint8_t buffers;
+  uint16_t frames;
+  int16_t stereo[AUDIO_BLOCK_MAX * 2];
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef SAMPLE_LOADER_H
+#define SAMPLE_LOADER_H
+
+#include <Arduino.h>
+#include "AudioFileSource.h"
+#include <VoiceMixer.h>
+
+#define SAMPLE_FADE 256 // fade out over this many samples when a file is cut short
+
+// Loads a WAV file into RAM for the voices, which need random access at
+// several pitches at once, which one streamed file cannot give. Mono IMA
+// ADPCM stays compressed (the voices decode it as they play) and 16-bit mono
+// PCM is kept as it is; anything else goes through AudioGeneratorWAV and is
+// mixed down to mono 16-bit. At most maxBytes are kept: a longer file is cut
+// and faded out, which the caller can tell from fileSamples (the length of
+// the whole file) > sample.length. sample points to heap memory afterwards.
+// Returns false if nothing could be loaded.
+bool loadSample(AudioFileSource *source, uint32_t maxBytes, Sample &sample, uint32_t &sampleRate,
+                uint32_t &fileSamples);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef STEP_CLOCK_H
+#define STEP_CLOCK_H
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include <StepSchedule.h>
+
+// Step clock driven by an esp_timer one-shot that is re-armed against absolute
+// deadlines (microseconds since boot), so a late wake-up never shifts the grid.
+// onStep/onGateOff run in the esp_timer task, not in loop().
+class StepClock
+{
+public:
+  typedef void (*StepCallback)(int64_t scheduled, int64_t fired);
+  typedef void (*GateCallback)(int64_t scheduled, int64_t fired);
+
+  StepClock();
+
+  bool begin(StepCallback onStep, GateCallback onGateOff);
+  // period is 32.32 fixed point us, see StepSchedule
+  void setPeriod(uint64_t period, uint32_t gateUs);
+  // Follows an external clock: new period and a grid through anchor (us since boot)
+  void align(int64_t anchor, uint64_t period, uint32_t gateUs);
+  uint32_t getInterval() const { return schedule.interval(); }
+  uint64_t getPeriod();
+  int64_t getNextStep();
+
+private:
+  static void timerCallback(void *arg);
+  void fire();
+  void arm(int64_t now);
+
+  esp_timer_handle_t timer;
+  portMUX_TYPE mux;
+  StepCallback onStep;
+  GateCallback onGateOff;
+  StepSchedule schedule;
+};
+
+#endif
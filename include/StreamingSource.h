@@ -0,0 +1,86 @@
+#ifndef STREAMING_SOURCE_H
+#define STREAMING_SOURCE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "AudioFileSource.h"
+#include <ByteRing.h>
+
+#define STREAM_RING_SIZE 32768 // ~370 ms of 44.1 kHz 16-bit mono, rides out a filesystem stall
+#define STREAM_CHUNK 4096      // bytes per filesystem read
+#define STREAM_PATH_MAX 64
+#define STREAM_POLL_MS 10       // prefetch task wakes at least this often
+#define STREAM_STALL_MS 200     // read() stops waiting for data after this
+#define STREAM_REQUEST_MS 1000  // open/seek/close wait this long for the prefetch task
+#define STREAM_WAIT_FOREVER UINT32_MAX
+#define STREAM_CORE 0
+#define STREAM_PRIORITY 1 // below the BLE task, file reads can take a while
+#define STREAM_STACK 3072
+
+// AudioFileSource for a file on SPIFFS or an SD card. A prefetch task of its
+// own keeps a ByteRing filled in STREAM_CHUNK reads, so the audio task only
+// copies from RAM and never waits on flash or SPI unless the ring ran dry
+// (counted in underruns()). open(), seek() outside the buffered data and
+// close() are handed to the prefetch task and wait for it.
+//
+// open/read/seek/close from one task (the audio task), the getters from anywhere.
+class StreamingSource : public AudioFileSource
+{
+public:
+  StreamingSource(fs::FS &fs);
+  ~StreamingSource() override { end(); }
+
+  // Starts the prefetch task
+  bool begin();
+  // Closes the file and ends the prefetch task; begin() starts it again.
+  // Waits for the task as long as it takes, so the object can be freed after.
+  void end();
+
+  bool open(const char *path) override;
+  uint32_t read(void *data, uint32_t length) override;
+  bool seek(int32_t pos, int dir) override;
+  bool close() override;
+  bool isOpen() override { return opened; }
+  uint32_t getSize() override { return size; }
+  uint32_t getPos() override { return position; }
+
+  uint32_t underruns() const { return underrunCount; }
+  size_t buffered() const { return ring.available(); }
+
+private:
+  enum Request
+  {
+    None,
+    Open,
+    Seek,
+    Close,
+    Quit
+  };
+
+  static void taskEntry(void *arg);
+  void run();
+  // Caller side: hands the request to the prefetch task and waits for it,
+  // timeoutMs in all, STREAM_WAIT_FOREVER for no limit
+  bool request(Request what, uint32_t arg, uint32_t timeoutMs = STREAM_REQUEST_MS);
+  // Prefetch task side. Returns true once the task has to end.
+  bool serve();
+  void fill();
+
+  fs::FS &fs;
+  fs::File file;
+  ByteRing<STREAM_RING_SIZE> ring;
+  uint8_t chunk[STREAM_CHUNK];
+  char path[STREAM_PATH_MAX];
+  TaskHandle_t task;
+  TaskHandle_t waiting;
+  volatile Request pending;
+  volatile uint32_t requestArg;
+  volatile bool requestOk;
+  volatile bool opened;
+  volatile bool eof; // the prefetch task read the last byte
+  volatile uint32_t size;
+  volatile uint32_t position; // consumer side
+  volatile uint32_t underrunCount;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "AudioPipeline.h"
+
+AudioPipeline::AudioPipeline(Clock c)
+    : clock(c), source(NULL), effectCount(0), sink(NULL), rate(44100), block(64), started(false), anchor(0),
+      queued(0), anchorFrames(0), fill(0)
+{
+  resetCounters();
+}
+
+bool AudioPipeline::addEffect(AudioEffect *effect)
+{
+  if (effectCount >= AUDIO_EFFECTS_MAX)
+    return false;
+  effects[effectCount++] = effect;
+  return true;
+}
+
+void AudioPipeline::setSink(AudioBlockSink *s)
+{
+  sink = s;
+  restart();
+}
+
+void AudioPipeline::setSampleRate(uint32_t hz)
+{
+  if (hz > 0)
+    rate = hz;
+  started = false;
+}
+
+bool AudioPipeline::setBlockSize(size_t frames)
+{
+  if (frames < AUDIO_BLOCK_MIN || frames > AUDIO_BLOCK_MAX)
+    return false;
+  block = frames;
+  return true;
+}
+
+uint32_t AudioPipeline::blockUs() const
+{
+  return framesUs(block);
+}
+
+void AudioPipeline::resetCounters()
+{
+  blockCount = 0;
+  lateCount = 0;
+  underrunCount = 0;
+  worstUs = 0;
+}
+
+bool AudioPipeline::run()
+{
+  if (sink == NULL)
+    return false;
+
+  int64_t start = clock();
+  if (source)
+    source->render(buffer, block);
+  else
+    for (size_t i = 0; i < block; i++)
+      buffer[i] = 0;
+  for (uint8_t i = 0; i < effectCount; i++)
+    effects[i]->process(buffer, block);
+  int64_t ready = clock();
+
+  uint32_t took = ready - start;
+  if (took > worstUs)
+    worstUs = took;
+  if (took > blockUs())
+    lateCount++;
+
+  // what was queued since the anchor has played out by playEnd
+  if (started)
+  {
+    int64_t playEnd = anchor + framesUs(anchorFrames + queued);
+    if (ready > playEnd)
+    {
+      underrunCount++;
+      started = false;
+    }
+  }
+  if (!started)
+  {
+    anchor = ready;
+    anchorFrames = 0;
+    queued = 0;
+    started = true;
+  }
+
+  size_t written = sink->write(buffer, block);
+  int64_t done = clock();
+  queued += written;
+  fill = (fill + written) % sink->bufferFrames();
+  // blocked for a good part of a block: the output was full and just freed a buffer
+  anchorQueued(done, done - ready > (int64_t)blockUs() / 2);
+  blockCount++;
+  return written == block;
+}
+
+void AudioPipeline::anchorQueued(int64_t now, bool blocked)
+{
+  uint32_t most = sink->capacity();
+  if (blocked)
+  {
+    // a write that ends on a buffer boundary filled the one it waited for
+    anchorFrames = most - sink->bufferFrames() + (fill > 0 ? fill : sink->bufferFrames());
+  }
+  else
+  {
+    // never more than the buffers hold, whatever the estimate says
+    int64_t left = anchor + framesUs(anchorFrames + queued) - now;
+    if (left <= framesUs(most))
+      return;
+    anchorFrames = most;
+  }
+  anchor = now;
+  queued = 0;
+}
+
+void DcBlocker::process(int16_t *block, size_t frames)
+{
+  for (size_t i = 0; i < frames; i++)
+  {
+    int32_t x = block[i];
+    // y carries 8 fraction bits so the slow pole does not stall on rounding
+    y1 = ((x - x1) << 8) + y1 - (y1 >> DC_BLOCK_SHIFT);
+    x1 = x;
+    int32_t y = y1 >> 8;
+    y = y < INT16_MIN ? INT16_MIN : y;
+    block[i] = y > INT16_MAX ? INT16_MAX : y;
+  }
+}
@@ -0,0 +1,123 @@
+#ifndef AUDIO_PIPELINE_H
+#define AUDIO_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AUDIO_BLOCK_MIN 16
+#define AUDIO_BLOCK_MAX 128
+#define AUDIO_EFFECTS_MAX 4
+
+// Generator stage: fills a block of mono frames
+class AudioBlockSource
+{
+public:
+  virtual ~AudioBlockSource() {}
+  virtual void render(int16_t *block, size_t frames) = 0;
+};
+
+// Effect stage: works on the block in place
+class AudioEffect
+{
+public:
+  virtual ~AudioEffect() {}
+  virtual void process(int16_t *block, size_t frames) = 0;
+};
+
+// Output stage: queues a block for playback, blocking while the output is
+// full. Returns the frames taken.
+class AudioBlockSink
+{
+public:
+  virtual ~AudioBlockSink() {}
+  virtual size_t write(const int16_t *block, size_t frames) = 0;
+  // Frames the output holds when full (all DMA buffers), for the timing estimate
+  virtual uint32_t capacity() const = 0;
+  // Frames per DMA buffer. Writes fill the buffers in turn, so a write that
+  // had to wait for a free buffer returns with all the others still queued.
+  virtual uint32_t bufferFrames() const = 0;
+};
+
+// Block based audio path: source -> effects -> sink, one block per run().
+//
+// Keeps two counters the output itself cannot report:
+// - late blocks: rendering plus effects took longer than the block plays
+// - underruns: the output ran dry before the block got there, estimated
+//   from the time the queued audio lasts. After a write that blocked, the
+//   output holds all DMA buffers but the one being filled plus what is in
+//   that one, which re-anchors the estimate, so clock drift between the
+//   output and the clock does not pile up.
+//
+// Single task. The clock returns us, esp_timer_get_time() on the device.
+class AudioPipeline
+{
+public:
+  typedef int64_t (*Clock)();
+
+  AudioPipeline(Clock clock);
+
+  void setSource(AudioBlockSource *s) { source = s; }
+  bool addEffect(AudioEffect *effect);
+  void setSink(AudioBlockSink *s);
+  void setSampleRate(uint32_t hz);
+  // AUDIO_BLOCK_MIN..AUDIO_BLOCK_MAX frames
+  bool setBlockSize(size_t frames);
+  size_t blockSize() const { return block; }
+
+  // Renders, processes and writes one block
+  bool run();
+  // The output was restarted (new DMA settings), the next block is not an underrun
+  void restart()
+  {
+    started = false;
+    fill = 0;
+  }
+  void resetCounters();
+
+  uint32_t blocks() const { return blockCount; }
+  uint32_t lateBlocks() const { return lateCount; }
+  uint32_t underruns() const { return underrunCount; }
+  uint32_t worstBlockUs() const { return worstUs; } // longest render + effects time
+  uint32_t blockUs() const;
+
+private:
+  int64_t framesUs(uint64_t frames) const { return frames * 1000000 / rate; }
+
+  Clock clock;
+  AudioBlockSource *source;
+  AudioEffect *effects[AUDIO_EFFECTS_MAX];
+  uint8_t effectCount;
+  AudioBlockSink *sink;
+  uint32_t rate;
+  size_t block;
+  int16_t buffer[AUDIO_BLOCK_MAX];
+
+  void anchorQueued(int64_t now, bool blocked);
+
+  bool started;
+  int64_t anchor;       // time the output was estimated to hold anchorFrames
+  uint64_t queued;      // frames written since the anchor, on top of anchorFrames
+  uint32_t anchorFrames;
+  uint32_t fill;        // frames in the DMA buffer being filled
+
+  volatile uint32_t blockCount;
+  volatile uint32_t lateCount;
+  volatile uint32_t underrunCount;
+  volatile uint32_t worstUs;
+};
+
+// One pole DC blocker, y = x - x1 + a * y1 with a = 1 - 2^-DC_BLOCK_SHIFT,
+// keeps a mix of offset samples from sitting off centre
+#define DC_BLOCK_SHIFT 8
+class DcBlocker : public AudioEffect
+{
+public:
+  DcBlocker() : x1(0), y1(0) {}
+  void process(int16_t *block, size_t frames) override;
+
+private:
+  int32_t x1;
+  int32_t y1; // Q8 extra precision
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "BleMidi.h"
+
+// Data bytes following a status byte, 0 for real-time and unsupported ones
+static uint8_t dataLength(uint8_t status)
+{
+  switch (status & 0xF0)
+  {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    if (status == 0xF1 || status == 0xF3)
+      return 1;
+    return status == 0xF2 ? 2 : 0;
+  default:
+    return 2;
+  }
+}
+
+int BleMidiParser::parse(const uint8_t *data, size_t length, MidiEvent *out, size_t maxOut)
+{
+  // header: bit 7 set, bit 6 reserved, timestamp bits 12-7
+  if (length < 2 || (data[0] & 0xC0) != 0x80)
+    return -1;
+
+  uint16_t high = data[0] & 0x3F;
+  int lastLow = -1;
+  uint16_t timestamp = high << 7;
+  size_t n = 0;
+  size_t pos = 1;
+
+  while (pos < length)
+  {
+    uint8_t b = data[pos];
+
+    if (b & 0x80)
+    {
+      // timestamp byte, low 7 bits; going backwards means bits 12-7 moved on
+      uint8_t low = b & 0x7F;
+      if (lastLow >= 0 && low < lastLow)
+        high = (high + 1) & 0x3F;
+      lastLow = low;
+      timestamp = (high << 7) | low;
+      if (++pos >= length)
+        return -1;
+      b = data[pos];
+    }
+
+    if (inSysex)
+    {
+      // SysEx payload is not used, only its end (or a real-time byte inside it) matters
+      if (b < 0x80)
+      {
+        pos++;
+        continue;
+      }
+      if (b == 0xF7)
+      {
+        inSysex = false;
+        pos++;
+        continue;
+      }
+      if (b < 0xF8)
+        inSysex = false; // unterminated, a new status byte ends it
+    }
+
+    uint8_t status;
+    if (b & 0x80)
+    {
+      pos++;
+      if (b >= 0xF8)
+      {
+        // real-time: no data, does not touch running status
+        if (n >= maxOut)
+          return -1;
+        out[n].timestamp = timestamp;
+        out[n].status = b;
+        out[n].data1 = out[n].data2 = 0;
+        n++;
+        continue;
+      }
+      if (b == 0xF0)
+      {
+        inSysex = true;
+        running = 0;
+        continue;
+      }
+      if (b == 0xF7)
+        continue;
+      // system common messages cancel running status
+      running = b < 0xF0 ? b : 0;
+      status = b;
+    }
+    else
+    {
+      if (running == 0)
+        return -1;
+      status = running;
+    }
+
+    uint8_t needed = dataLength(status);
+    if (pos + needed > length)
+      return -1;
+    if (n >= maxOut)
+      return -1;
+    out[n].timestamp = timestamp;
+    out[n].status = status;
+    out[n].data1 = out[n].data2 = 0;
+    for (uint8_t i = 0; i < needed; i++)
+    {
+      if (data[pos] & 0x80)
+        return -1;
+      if (i == 0)
+        out[n].data1 = data[pos];
+      else
+        out[n].data2 = data[pos];
+      pos++;
+    }
+    n++;
+  }
+  return n;
+}
+
+// Value with the given low 13 bits that is nearest to around
+static int64_t nearest(int64_t around, uint16_t timestamp)
+{
+  int64_t low = ((around % MIDI_TIMESTAMP_MODULO) + MIDI_TIMESTAMP_MODULO) % MIDI_TIMESTAMP_MODULO;
+  int64_t difference = (int64_t)timestamp - low;
+  if (difference >= MIDI_TIMESTAMP_MODULO / 2)
+    difference -= MIDI_TIMESTAMP_MODULO;
+  else if (difference < -MIDI_TIMESTAMP_MODULO / 2)
+    difference += MIDI_TIMESTAMP_MODULO;
+  return around + difference;
+}
+
+int64_t MidiTimeline::unwrap(uint16_t timestamp) const
+{
+  return nearest(reference, timestamp);
+}
+
+void MidiTimeline::onPacket(int64_t arrivalUs, uint16_t timestamp)
+{
+  if (!valid)
+  {
+    reference = timestamp;
+    offset = arrivalUs - (int64_t)timestamp * 1000;
+    delay = 0;
+    valid = true;
+    return;
+  }
+
+  // around the sender clock as we expect it now, so long gaps between packets still unwrap right
+  reference = nearest((arrivalUs - offset) / 1000, timestamp);
+
+  int64_t sample = arrivalUs - reference * 1000;
+  if (sample < offset)
+    offset = sample;
+  else
+    offset += MIDI_OFFSET_RELAX_US;
+  delay = sample - offset;
+}
+
+int64_t MidiTimeline::toDevice(uint16_t timestamp) const
+{
+  if (!valid)
+    return 0;
+  return unwrap(timestamp) * 1000 + offset;
+}
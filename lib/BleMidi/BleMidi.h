@@ -0,0 +1,77 @@
+#ifndef BLE_MIDI_H
+#define BLE_MIDI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MIDI_TIMESTAMP_MODULO 8192 // BLE-MIDI timestamps are 13 bits of milliseconds
+#define MIDI_OFFSET_RELAX_US 2     // lets the offset follow a sender clock running slow
+
+// MIDI status bytes the firmware acts on
+#define MIDI_NOTE_OFF 0x80
+#define MIDI_NOTE_ON 0x90
+#define MIDI_CLOCK 0xF8
+#define MIDI_START 0xFA
+#define MIDI_CONTINUE 0xFB
+#define MIDI_STOP 0xFC
+
+// One decoded MIDI message with the sender's timestamp (ms, 13 bits)
+struct MidiEvent
+{
+  uint16_t timestamp;
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+};
+
+// Parser for BLE-MIDI packets: header byte, then timestamped messages,
+// several per packet, with running status (also across packets) and system
+// real-time messages. SysEx is skipped, including across packets.
+class BleMidiParser
+{
+public:
+  BleMidiParser() { reset(); }
+
+  void reset()
+  {
+    running = 0;
+    inSysex = false;
+  }
+
+  // Returns the number of events written to out, or -1 for a malformed packet
+  // (what was decoded before the error is still in out but not counted).
+  int parse(const uint8_t *data, size_t length, MidiEvent *out, size_t maxOut);
+
+private:
+  uint8_t running;
+  bool inSysex;
+};
+
+// Maps sender timestamps onto device time (us). Packets are delayed by a
+// varying amount (connection events), the least delayed ones show the true
+// offset between both clocks; the offset keeps the minimum seen and relaxes
+// slowly so it can follow clock drift. Events keep the sender's spacing.
+class MidiTimeline
+{
+public:
+  MidiTimeline() { reset(); }
+
+  void reset() { valid = false; }
+
+  // Once per packet, with the timestamp of its first event
+  void onPacket(int64_t arrivalUs, uint16_t timestamp);
+  // When the sender played the event, on the device clock
+  int64_t toDevice(uint16_t timestamp) const;
+  // How much later than the least delayed packet the last one arrived, us
+  int32_t lastDelay() const { return delay; }
+
+private:
+  int64_t unwrap(uint16_t timestamp) const;
+
+  bool valid;
+  int64_t offset;    // device us - sender ms * 1000
+  int64_t reference; // unwrapped sender ms of the last packet
+  int32_t delay;
+};
+
+#endif
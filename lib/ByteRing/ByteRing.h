@@ -0,0 +1,86 @@
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Wait-free single-producer/single-consumer byte ring with bulk copies, for
+// streams where moving one byte per call (SpscQueue<uint8_t>) would cost more
+// than the data. One task may call write(), one other task read()/skip().
+// Size must be a power of two; one byte is never used so full != empty.
+template <size_t Size>
+class ByteRing
+{
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+  ByteRing() : head(0), tail(0) {}
+
+  // Copies as much as fits, returns the number of bytes written
+  size_t write(const uint8_t *data, size_t length)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t free = (t - h - 1) & (Size - 1);
+    if (length > free)
+      length = free;
+    size_t first = Size - h < length ? Size - h : length;
+    memcpy(buffer + h, data, first);
+    memcpy(buffer, data + first, length - first);
+    head.store((h + length) & (Size - 1), std::memory_order_release);
+    return length;
+  }
+
+  // Copies up to length bytes out, returns the number of bytes read
+  size_t read(uint8_t *data, size_t length)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t used = (h - t) & (Size - 1);
+    if (length > used)
+      length = used;
+    size_t first = Size - t < length ? Size - t : length;
+    memcpy(data, buffer + t, first);
+    memcpy(data + first, buffer, length - first);
+    tail.store((t + length) & (Size - 1), std::memory_order_release);
+    return length;
+  }
+
+  // Drops up to length bytes, returns the number of bytes dropped
+  size_t skip(size_t length)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t used = (head.load(std::memory_order_acquire) - t) & (Size - 1);
+    if (length > used)
+      length = used;
+    tail.store((t + length) & (Size - 1), std::memory_order_release);
+    return length;
+  }
+
+  // Exact for the consumer, a lower bound seen from the producer
+  size_t available() const
+  {
+    return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (Size - 1);
+  }
+
+  // Exact for the producer, a lower bound seen from the consumer
+  size_t space() const { return Size - 1 - available(); }
+
+  size_t capacity() const { return Size - 1; }
+
+  // Only while neither side is inside write() or read()
+  void clear()
+  {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_release);
+  }
+
+private:
+  uint8_t buffer[Size];
+  std::atomic<size_t> head; // written by producer
+  std::atomic<size_t> tail; // written by consumer
+};
+
+#endif
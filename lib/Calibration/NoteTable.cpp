@@ -0,0 +1,26 @@
+#include "NoteTable.h"
+
+NoteCode splitCode(uint32_t code)
+{
+  NoteCode out;
+  if (code > DAC_TOTAL_CODE)
+    code = DAC_TOTAL_CODE;
+  if (code <= DAC_SPLIT_CODE)
+  {
+    out.c = code;
+    out.d = 0;
+  }
+  else
+  {
+    out.c = DAC_SPLIT_CODE;
+    out.d = code - DAC_SPLIT_CODE;
+  }
+  return out;
+}
+
+void buildDefaultTable(NoteTable &table)
+{
+  table.magic = NOTE_TABLE_MAGIC;
+  for (uint8_t n = 0; n < NOTE_COUNT; n++)
+    table.notes[n] = splitCode((n * 1000 + 6) / 12);
+}
@@ -0,0 +1,31 @@
+#ifndef NOTE_TABLE_H
+#define NOTE_TABLE_H
+
+#include <stdint.h>
+
+#define NOTE_COUNT 97        // 8 octaves from note 0 (0 V)
+#define DAC_MAX_CODE 4095
+#define DAC_SPLIT_CODE 4000  // channel C tops out here, channel D adds the rest (1 mV per code)
+#define DAC_TOTAL_CODE (DAC_SPLIT_CODE + DAC_MAX_CODE)
+#define NOTE_TABLE_MAGIC 0x4F574C31 // "OWL1"
+
+// DAC codes for channels C and D per note, so playNote() is a single lookup
+struct NoteCode
+{
+  uint16_t c;
+  uint16_t d;
+};
+
+struct NoteTable
+{
+  uint32_t magic;
+  NoteCode notes[NOTE_COUNT];
+};
+
+// Splits a combined 0..DAC_TOTAL_CODE value over the two summed channels
+NoteCode splitCode(uint32_t code);
+
+// Ideal 1V/oct table, 1000/12 mV per semitone
+void buildDefaultTable(NoteTable &table);
+
+#endif
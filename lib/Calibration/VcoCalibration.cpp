@@ -0,0 +1,49 @@
+#include "VcoCalibration.h"
+#include <math.h>
+
+bool VcoCalibration::addPoint(uint32_t code, float hz)
+{
+  if (count >= CALIBRATION_MAX_POINTS || hz <= 0)
+    return false;
+  codes[count] = code;
+  logHz[count] = log2f(hz);
+  count++;
+  return true;
+}
+
+uint8_t VcoCalibration::build(NoteTable &table) const
+{
+  if (count < 2)
+    return 0;
+  for (uint8_t i = 1; i < count; i++)
+  {
+    if (codes[i] <= codes[i - 1] || logHz[i] <= logHz[i - 1])
+      return 0;
+  }
+
+  table.magic = NOTE_TABLE_MAGIC;
+  uint8_t reached = 0;
+  uint8_t segment = 0;
+  float base = logHz[0];
+
+  for (uint8_t n = 0; n < NOTE_COUNT; n++)
+  {
+    float target = base + n / 12.0f;
+    while (segment < count - 2 && logHz[segment + 1] < target)
+      segment++;
+
+    uint32_t code;
+    if (target > logHz[count - 1])
+    {
+      code = codes[count - 1];
+    }
+    else
+    {
+      float t = (target - logHz[segment]) / (logHz[segment + 1] - logHz[segment]);
+      code = codes[segment] + (uint32_t)lroundf(t * (codes[segment + 1] - codes[segment]));
+      reached++;
+    }
+    table.notes[n] = splitCode(code);
+  }
+  return reached;
+}
@@ -0,0 +1,33 @@
+#ifndef VCO_CALIBRATION_H
+#define VCO_CALIBRATION_H
+
+#include <stdint.h>
+#include "NoteTable.h"
+
+#define CALIBRATION_MAX_POINTS 80
+
+// Collects (DAC code, measured frequency) pairs from a sweep and turns them
+// into a note table: note 0 is whatever the VCO plays at the lowest code and
+// every note n is placed at the code where the curve crosses f0 * 2^(n/12),
+// interpolating in log frequency between the two nearest points.
+class VcoCalibration
+{
+public:
+  VcoCalibration() : count(0) {}
+
+  void clear() { count = 0; }
+  bool addPoint(uint32_t code, float hz);
+  uint8_t points() const { return count; }
+
+  // Fills table and returns how many notes the sweep could reach. Notes above
+  // the VCO range are clamped to the top code. Returns 0 if the sweep is
+  // unusable (too few points, no signal or not increasing).
+  uint8_t build(NoteTable &table) const;
+
+private:
+  uint32_t codes[CALIBRATION_MAX_POINTS];
+  float logHz[CALIBRATION_MAX_POINTS];
+  uint8_t count;
+};
+
+#endif
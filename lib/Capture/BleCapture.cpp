@@ -0,0 +1,85 @@
+#include "BleCapture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+void makeRecord(CaptureRecord &record, uint32_t timestamp, const uint8_t *data, size_t length)
+{
+  record.original = length > UINT16_MAX ? UINT16_MAX : length;
+  if (length > CAPTURE_MAX_DATA)
+    length = CAPTURE_MAX_DATA;
+  record.timestamp = timestamp;
+  record.length = length;
+  memcpy(record.data, data, length);
+}
+
+size_t formatRecord(const CaptureRecord &record, char *line, size_t size)
+{
+  int n = snprintf(line, size, "W %lu %u ", (unsigned long)record.timestamp, record.length);
+  if (n < 0 || (size_t)n + 2 * record.length + 1 > size)
+    return 0;
+  char *p = line + n;
+  for (uint8_t i = 0; i < record.length; i++)
+  {
+    *p++ = hexDigits[record.data[i] >> 4];
+    *p++ = hexDigits[record.data[i] & 0x0F];
+  }
+  *p = '\0';
+  if (record.cut())
+  {
+    size_t used = p - line;
+    int tail = snprintf(p, size - used, " %u", record.original);
+    if (tail < 0 || used + tail + 1 > size)
+      return 0;
+    p += tail;
+  }
+  return p - line;
+}
+
+bool parseRecord(const char *line, CaptureRecord &record)
+{
+  if (line[0] != 'W' || line[1] != ' ')
+    return false;
+
+  char *end;
+  unsigned long timestamp = strtoul(line + 2, &end, 10);
+  if (*end != ' ')
+    return false;
+  unsigned long length = strtoul(end + 1, &end, 10);
+  if (*end != ' ' || length > CAPTURE_MAX_DATA)
+    return false;
+
+  const char *hex = end + 1;
+  for (unsigned long i = 0; i < length; i++)
+  {
+    int hi = hexValue(hex[2 * i]);
+    int lo = hi < 0 ? -1 : hexValue(hex[2 * i + 1]);
+    if (lo < 0)
+      return false;
+    record.data[i] = (hi << 4) | lo;
+  }
+  unsigned long original = length;
+  if (hex[2 * length] == ' ')
+  {
+    original = strtoul(hex + 2 * length + 1, &end, 10);
+    if (original <= length || original > UINT16_MAX)
+      return false;
+  }
+  record.timestamp = timestamp;
+  record.length = length;
+  record.original = original;
+  return true;
+}
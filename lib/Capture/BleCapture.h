@@ -0,0 +1,41 @@
+#ifndef BLE_CAPTURE_H
+#define BLE_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Defs.h>
+
+// Text capture format for inbound characteristic writes, one write per line:
+//
+//   W <timestamp us> <length> <hex bytes> [<original length>]
+//   W 10234567 3 047f18
+//
+// The original length only follows when the write was longer than
+// CAPTURE_MAX_DATA and got cut, which the stack should never deliver.
+//
+// Lines starting with '#' are comments. Timestamps are the device micros() at
+// onWrite and are only compared with each other. The same format is printed by
+// the firmware with BLE_CAPTURE enabled and read by the native replayer.
+
+#define CAPTURE_MAX_DATA (BLE_MTU - 3) // the longest single write
+#define CAPTURE_LINE_LENGTH (32 + 2 * CAPTURE_MAX_DATA)
+
+struct CaptureRecord
+{
+  uint32_t timestamp;
+  uint16_t original; // bytes the write had
+  uint8_t length;    // bytes kept, writes longer than CAPTURE_MAX_DATA are cut
+  uint8_t data[CAPTURE_MAX_DATA];
+
+  bool cut() const { return original > length; }
+};
+
+void makeRecord(CaptureRecord &record, uint32_t timestamp, const uint8_t *data, size_t length);
+
+// Returns the line length, 0 if it does not fit
+size_t formatRecord(const CaptureRecord &record, char *line, size_t size);
+
+// Returns false for comments, blank or malformed lines
+bool parseRecord(const char *line, CaptureRecord &record);
+
+#endif
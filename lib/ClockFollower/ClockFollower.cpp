@@ -0,0 +1,105 @@
+#include "ClockFollower.h"
+
+// 100 * 60 s in us
+#define CENTI_MINUTE_US 6000000000ULL
+
+ClockFollower::ClockFollower(uint8_t pulsesPerBeat)
+    : ppqn(pulsesPerBeat ? pulsesPerBeat : 1)
+{
+  reset();
+  pulseIndex = ppqn - 1;
+}
+
+void ClockFollower::reset()
+{
+  pulses = 0;
+  lastPulse = 0;
+  estimate = 0;
+  pulsePeriod = 0;
+  goodPulses = 0;
+  isLocked = false;
+  lastError = 0;
+  tempo = 0;
+}
+
+void ClockFollower::seed(int64_t at, int64_t interval)
+{
+  estimate = at;
+  pulsePeriod = (uint64_t)interval << 32;
+  goodPulses = 0;
+  isLocked = false;
+}
+
+bool ClockFollower::pulse(int64_t at)
+{
+  if (pulses == 0)
+  {
+    pulses = 1;
+    lastPulse = at;
+    pulseIndex = (pulseIndex + 1) % ppqn;
+    return false;
+  }
+
+  int64_t interval = at - lastPulse;
+  if (pulses == 1)
+  {
+    if (interval <= 0)
+      return false;
+    seed(at, interval);
+  }
+  else
+  {
+    uint32_t us = periodUs();
+    int64_t predicted = estimate + us;
+    int64_t error = at - predicted;
+    int64_t magnitude = error < 0 ? -error : error;
+
+    if (magnitude > us / 4)
+    {
+      // a bounce or crosstalk edge between two pulses does not count as a pulse
+      if (interval < us / 2)
+        return isLocked;
+      seed(at, interval);
+    }
+    else
+    {
+      estimate = predicted + error / (1 << CLOCK_PHASE_SHIFT);
+      pulsePeriod += error * ((int64_t)1 << (32 - CLOCK_FREQ_SHIFT));
+      lastError = error;
+
+      if (magnitude <= us >> CLOCK_LOCK_SHIFT)
+      {
+        if (goodPulses < CLOCK_LOCK_PULSES)
+          goodPulses++;
+      }
+      else if (magnitude > us >> CLOCK_UNLOCK_SHIFT)
+      {
+        goodPulses = 0;
+      }
+      isLocked = goodPulses >= CLOCK_LOCK_PULSES;
+    }
+  }
+
+  pulses++;
+  lastPulse = at;
+  pulseIndex = (pulseIndex + 1) % ppqn;
+  tempo = ((CENTI_MINUTE_US << 16) / (pulsePeriod >> 16)) / ppqn;
+  return isLocked;
+}
+
+void ClockFollower::expire(int64_t now)
+{
+  if (pulses > 1 && now - lastPulse > (int64_t)periodUs() * CLOCK_TIMEOUT_PERIODS)
+  {
+    uint8_t index = pulseIndex;
+    reset();
+    pulseIndex = index;
+  }
+}
+
+uint64_t ClockFollower::stepPeriod(uint8_t stepsPerBeat) const
+{
+  if (stepsPerBeat == 0)
+    stepsPerBeat = 1;
+  return pulsePeriod * ppqn / stepsPerBeat;
+}
@@ -0,0 +1,67 @@
+#ifndef CLOCK_FOLLOWER_H
+#define CLOCK_FOLLOWER_H
+
+#include <stdint.h>
+
+#define CLOCK_PHASE_SHIFT 2  // phase gain 1/4 of the error per pulse
+#define CLOCK_FREQ_SHIFT 5   // period gain 1/32 of the error per pulse
+#define CLOCK_LOCK_SHIFT 5   // errors within 1/32 of a period count towards lock
+#define CLOCK_UNLOCK_SHIFT 3 // an error beyond 1/8 of a period drops the lock
+#define CLOCK_LOCK_PULSES 8
+#define CLOCK_TIMEOUT_PERIODS 4 // no pulse for this many periods: start over
+
+// Second order software PLL following an external clock from pulse timestamps
+// (absolute us). It predicts every pulse from the filtered phase and period,
+// then pulls both towards the measured pulse by a fixed fraction of the error,
+// so interrupt jitter is averaged out while tempo changes are still followed.
+// Pulses far off the prediction either are spurious edges (ignored) or mean
+// the tempo jumped, in which case the loop re-seeds from the raw interval.
+//
+// Integer only. pulse() and the step helpers belong to one task; locked(),
+// phaseError() and centiBpm() are single words and may be read from anywhere.
+class ClockFollower
+{
+public:
+  ClockFollower(uint8_t ppqn);
+
+  void reset();
+  // Next pulse is the first of a beat (reset input)
+  void rewind() { pulseIndex = ppqn - 1; }
+
+  // Feeds one pulse, returns whether the loop is locked
+  bool pulse(int64_t at);
+  // Drops the lock when the clock stopped
+  void expire(int64_t now);
+
+  bool locked() const { return isLocked; }
+  // Measured pulse minus predicted pulse of the last pulse, us
+  int32_t phaseError() const { return lastError; }
+  uint32_t centiBpm() const { return tempo; }
+
+  // Filtered time of the last pulse, the anchor for the step grid
+  int64_t phase() const { return estimate; }
+  // 32.32 us per pulse
+  uint64_t period() const { return pulsePeriod; }
+
+  // Whether the last pulse falls on a step with stepsPerBeat steps per beat,
+  // and the step period derived from the pulse period (32.32 us)
+  bool onStep(uint8_t stepsPerBeat) const { return (pulseIndex * stepsPerBeat) % ppqn == 0; }
+  uint64_t stepPeriod(uint8_t stepsPerBeat) const;
+
+private:
+  void seed(int64_t at, int64_t interval);
+  uint32_t periodUs() const { return (pulsePeriod + (1ULL << 31)) >> 32; }
+
+  uint8_t ppqn;
+  uint8_t pulseIndex; // position of the last pulse within the beat
+  uint32_t pulses;
+  int64_t lastPulse;
+  int64_t estimate;
+  uint64_t pulsePeriod;
+  uint8_t goodPulses;
+  volatile bool isLocked;
+  volatile int32_t lastError;
+  volatile uint32_t tempo; // 1/100 BPM
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "ConnectionFsm.h"
+
+void ConnectionFsm::enter(State next, uint32_t nowMs)
+{
+  current = next;
+  since = nowMs;
+}
+
+ConnectionFsm::Action ConnectionFsm::update(uint32_t nowMs, bool connected, bool subscribed)
+{
+  uint32_t elapsed = nowMs - since;
+
+  switch (current)
+  {
+  case Advertising:
+    if (connected)
+      enter(Connecting, nowMs);
+    break;
+
+  case Connecting:
+    if (!connected)
+    {
+      enter(Disconnecting, nowMs);
+    }
+    else if ((subscribed && elapsed >= CONNECT_SETTLE_MIN_MS) || elapsed >= CONNECT_SETTLE_MAX_MS)
+    {
+      enter(Ready, nowMs);
+      return PushState;
+    }
+    break;
+
+  case Ready:
+    if (!connected)
+      enter(Disconnecting, nowMs);
+    break;
+
+  case Disconnecting:
+    if (connected)
+    {
+      enter(Connecting, nowMs);
+    }
+    else if (elapsed >= DISCONNECT_SETTLE_MS)
+    {
+      enter(Advertising, nowMs);
+      return StartAdvertising;
+    }
+    break;
+  }
+  return None;
+}
@@ -0,0 +1,44 @@
+#ifndef CONNECTION_FSM_H
+#define CONNECTION_FSM_H
+
+#include <stdint.h>
+
+#define CONNECT_SETTLE_MIN_MS 100   // let the central finish discovery before pushing
+#define CONNECT_SETTLE_MAX_MS 3000  // push anyway if it never subscribes
+#define DISCONNECT_SETTLE_MS 500    // give the stack time before advertising again
+
+// Non-blocking replacement for the delay() calls around connect/disconnect.
+// update() is called periodically from the BLE task and tells it what to do.
+class ConnectionFsm
+{
+public:
+  enum State
+  {
+    Advertising,
+    Connecting,
+    Ready,
+    Disconnecting
+  };
+
+  enum Action
+  {
+    None,
+    PushState,       // stack is ready, send the whole sequencer state
+    StartAdvertising
+  };
+
+  ConnectionFsm() : current(Advertising), since(0) {}
+
+  Action update(uint32_t nowMs, bool connected, bool subscribed);
+
+  State state() const { return current; }
+  bool ready() const { return current == Ready; }
+
+private:
+  void enter(State next, uint32_t nowMs);
+
+  State current;
+  uint32_t since;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "FrequencyEstimator.h"
+
+FrequencyEstimator::FrequencyEstimator(uint32_t clock, uint32_t window, uint16_t cyclesMax)
+    : clockHz(clock), windowTicks(window), maxCycles(cyclesMax), resetPending(false), primed(false), last(0),
+      sumTicks(0), cycles(0), sequence(0), publishedTicks(0), publishedCycles(0)
+{
+}
+
+void FrequencyEstimator::onCapture(uint32_t ticks, uint8_t edges)
+{
+  if (resetPending.exchange(false, std::memory_order_acq_rel))
+  {
+    primed = false;
+    sumTicks = 0;
+    cycles = 0;
+  }
+  if (!primed)
+  {
+    primed = true;
+    last = ticks;
+    return;
+  }
+
+  // unsigned subtraction handles the counter wrapping around
+  sumTicks += ticks - last;
+  cycles += edges;
+  last = ticks;
+
+  if (cycles >= maxCycles || sumTicks >= windowTicks)
+  {
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_release);
+    publishedTicks = sumTicks;
+    publishedCycles = cycles;
+    sequence.store(seq + 2, std::memory_order_release);
+    sumTicks = 0;
+    cycles = 0;
+  }
+}
+
+float FrequencyEstimator::read() const
+{
+  uint32_t seq, ticks, count;
+  do
+  {
+    seq = sequence.load(std::memory_order_acquire);
+    ticks = publishedTicks;
+    count = publishedCycles;
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != sequence.load(std::memory_order_acquire));
+
+  if (ticks == 0)
+    return 0;
+  return (float)count * (float)clockHz / (float)ticks;
+}
@@ -0,0 +1,50 @@
+#ifndef FREQUENCY_ESTIMATOR_H
+#define FREQUENCY_ESTIMATOR_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Averages the period over several cycles from raw capture timestamps.
+// A new estimate is published when maxCycles periods have been seen or when
+// the accumulated time reaches windowTicks, whichever comes first, so slow
+// signals still update every cycle and fast ones are averaged over many.
+// onCapture() is integer only so it can run in an ISR; read() does the float math.
+class FrequencyEstimator
+{
+public:
+  FrequencyEstimator(uint32_t clockHz, uint32_t windowTicks, uint16_t maxCycles);
+
+  // Single producer: capture ISR. edges = input edges per capture (hardware prescaler)
+  void onCapture(uint32_t ticks, uint8_t edges = 1);
+
+  // Last published frequency in Hz, 0 before the first estimate
+  float read() const;
+  // Changes every time a new estimate is published
+  uint32_t updates() const { return sequence.load(std::memory_order_acquire) >> 1; }
+  // Capture timestamp of the last edge, to detect a signal that stopped
+  uint32_t lastCapture() const { return last; }
+
+  // Any task: drops the cycles accumulated so far. Only flags it, the ISR
+  // side clears its state on the next capture, so nothing races onCapture().
+  void reset() { resetPending.store(true, std::memory_order_release); }
+
+private:
+  uint32_t clockHz;
+  uint32_t windowTicks;
+  uint16_t maxCycles;
+
+  std::atomic<bool> resetPending;
+
+  // ISR side
+  bool primed;
+  uint32_t last;
+  uint32_t sumTicks;
+  uint32_t cycles;
+
+  // published pair, guarded by a sequence counter (odd while being written)
+  std::atomic<uint32_t> sequence;
+  uint32_t publishedTicks;
+  uint32_t publishedCycles;
+};
+
+#endif
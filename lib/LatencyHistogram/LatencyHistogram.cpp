@@ -0,0 +1,74 @@
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+void LatencyHistogram::reset()
+{
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    counts[i] = 0;
+  head = 0;
+  count = 0;
+}
+
+uint8_t LatencyHistogram::bucketFor(uint32_t us)
+{
+  uint8_t index = 0;
+  us >>= LATENCY_FIRST_SHIFT;
+  while (us != 0 && index < LATENCY_BUCKETS - 1)
+  {
+    us >>= 1;
+    index++;
+  }
+  return index;
+}
+
+uint32_t LatencyHistogram::bucketLimit(uint8_t index)
+{
+  if (index >= LATENCY_BUCKETS - 1)
+    return UINT32_MAX;
+  return (uint32_t)1 << (LATENCY_FIRST_SHIFT + index);
+}
+
+void LatencyHistogram::add(uint32_t us)
+{
+  if (count == LATENCY_WINDOW)
+    counts[bucketFor(window[head])]--;
+  else
+    count++;
+  window[head] = us;
+  counts[bucketFor(us)]++;
+  head = head + 1 == LATENCY_WINDOW ? 0 : head + 1;
+}
+
+uint32_t LatencyHistogram::max() const
+{
+  uint32_t largest = 0;
+  // the window is filled from index 0, so the first count entries are the samples
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (window[i] > largest)
+      largest = window[i];
+  }
+  return largest;
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t percent) const
+{
+  if (count == 0)
+    return 0;
+  // rank of the sample, 1 based, rounded up
+  uint32_t rank = ((uint32_t)count * percent + 99) / 100;
+  if (rank == 0)
+    rank = 1;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+      return bucketLimit(i);
+  }
+  return bucketLimit(LATENCY_BUCKETS - 1);
+}
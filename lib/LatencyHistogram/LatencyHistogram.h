@@ -0,0 +1,43 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define LATENCY_WINDOW 255 // samples kept, so every bucket count fits a byte
+#define LATENCY_BUCKETS 14
+#define LATENCY_FIRST_SHIFT 7 // bucket 0 is below 128 us
+
+// Rolling histogram of the last LATENCY_WINDOW latencies (us). Buckets double
+// in width: bucket 0 holds everything below 128 us, bucket k (k > 0) holds
+// [64 << k, 128 << k) and the last one everything from 512 ms up. Adding a
+// sample past the window evicts the oldest one, so the counts always describe
+// recent traffic rather than the whole session.
+//
+// Not thread safe, one task owns it.
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void reset();
+  void add(uint32_t us);
+
+  uint8_t samples() const { return count; }
+  uint8_t bucket(uint8_t index) const { return counts[index]; }
+  // Largest sample in the window, 0 when empty
+  uint32_t max() const;
+  // Upper limit of the bucket holding the given percentile, 0 when empty
+  uint32_t percentile(uint8_t percent) const;
+
+  static uint8_t bucketFor(uint32_t us);
+  // Exclusive upper limit of a bucket, UINT32_MAX for the last one
+  static uint32_t bucketLimit(uint8_t index);
+
+private:
+  uint32_t window[LATENCY_WINDOW];
+  uint8_t counts[LATENCY_BUCKETS];
+  uint8_t head;
+  uint8_t count;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include "Adafruit_MCP4728.h"
+#include "Arduino.h"
+
+bool Adafruit_MCP4728::setChannelValue(MCP4728_channel_t channel, uint16_t newValue,
+                                       MCP4728_vref_t vref, MCP4728_gain_t gain)
+{
+  value[channel] = newValue;
+  writes++;
+  VirtualClock::advance(transactionUs);
+  return true;
+}
+
+bool Adafruit_MCP4728::fastWrite(uint16_t a, uint16_t b, uint16_t c, uint16_t d)
+{
+  value[0] = a;
+  value[1] = b;
+  value[2] = c;
+  value[3] = d;
+  writes++;
+  VirtualClock::advance(transactionUs);
+  return true;
+}
@@ -0,0 +1,48 @@
+#ifndef NATIVE_ADAFRUIT_MCP4728_H
+#define NATIVE_ADAFRUIT_MCP4728_H
+
+#include <stdint.h>
+
+// Records DAC writes instead of talking I2C. I2C time can be charged to the
+// virtual clock per transaction to model the bus cost.
+typedef enum
+{
+  MCP4728_CHANNEL_A,
+  MCP4728_CHANNEL_B,
+  MCP4728_CHANNEL_C,
+  MCP4728_CHANNEL_D,
+} MCP4728_channel_t;
+
+typedef enum
+{
+  MCP4728_VREF_VDD,
+  MCP4728_VREF_INTERNAL,
+} MCP4728_vref_t;
+
+typedef enum
+{
+  MCP4728_GAIN_1X,
+  MCP4728_GAIN_2X,
+} MCP4728_gain_t;
+
+class Adafruit_MCP4728
+{
+public:
+  Adafruit_MCP4728() : writes(0), transactionUs(0)
+  {
+    for (int i = 0; i < 4; i++)
+      value[i] = 0;
+  }
+
+  bool begin() { return true; }
+  bool setChannelValue(MCP4728_channel_t channel, uint16_t newValue,
+                       MCP4728_vref_t vref = MCP4728_VREF_VDD, MCP4728_gain_t gain = MCP4728_GAIN_1X);
+  bool fastWrite(uint16_t a, uint16_t b, uint16_t c, uint16_t d);
+  bool saveToEEPROM() { return true; }
+
+  uint16_t value[4];
+  uint32_t writes;
+  uint32_t transactionUs; // virtual time charged per I2C transaction
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "Arduino.h"
+
+NativeSerial Serial;
+
+static uint64_t clockUs = 0;
+static uint8_t pinLevel[NATIVE_PINS];
+static uint64_t pinChange[NATIVE_PINS];
+static uint32_t pinWrites[NATIVE_PINS];
+
+unsigned long millis() { return (unsigned long)(clockUs / 1000); }
+unsigned long micros() { return (unsigned long)clockUs; }
+void delay(unsigned long ms) { clockUs += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { clockUs += us; }
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin >= NATIVE_PINS)
+    return;
+  pinWrites[pin]++;
+  if (pinLevel[pin] != value)
+  {
+    pinLevel[pin] = value;
+    pinChange[pin] = clockUs;
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < NATIVE_PINS ? pinLevel[pin] : LOW;
+}
+
+namespace VirtualClock
+{
+  uint64_t now() { return clockUs; }
+  void set(uint64_t us) { clockUs = us; }
+  void advance(uint64_t us) { clockUs += us; }
+}
+
+namespace VirtualPins
+{
+  void setInput(uint8_t pin, uint8_t value)
+  {
+    if (pin < NATIVE_PINS)
+      pinLevel[pin] = value;
+  }
+  uint8_t level(uint8_t pin) { return pin < NATIVE_PINS ? pinLevel[pin] : LOW; }
+  uint64_t lastChange(uint8_t pin) { return pin < NATIVE_PINS ? pinChange[pin] : 0; }
+  uint32_t writes(uint8_t pin) { return pin < NATIVE_PINS ? pinWrites[pin] : 0; }
+  void reset()
+  {
+    memset(pinLevel, 0, sizeof(pinLevel));
+    memset(pinChange, 0, sizeof(pinChange));
+    memset(pinWrites, 0, sizeof(pinWrites));
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Minimal Arduino API for the native environment. Time comes from a virtual
+// microsecond clock that only moves when the host program advances it, so
+// runs are deterministic.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define PROGMEM
+#define IRAM_ATTR
+
+#define NATIVE_PINS 40
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Host side controls
+namespace VirtualClock
+{
+  uint64_t now();             // us
+  void set(uint64_t us);
+  void advance(uint64_t us);
+}
+
+namespace VirtualPins
+{
+  // Value the firmware reads back with digitalRead()
+  void setInput(uint8_t pin, uint8_t value);
+  uint8_t level(uint8_t pin);
+  // Virtual time of the last change of an output and number of writes
+  uint64_t lastChange(uint8_t pin);
+  uint32_t writes(uint8_t pin);
+  void reset();
+}
+
+class NativeSerial
+{
+public:
+  void begin(unsigned long) {}
+  void print(const char *s) { fputs(s, stdout); }
+  void print(int v) { printf("%d", v); }
+  void print(unsigned int v) { printf("%u", v); }
+  void print(long v) { printf("%ld", v); }
+  void print(unsigned long v) { printf("%lu", v); }
+  void print(double v) { printf("%.2f", v); }
+  template <typename T>
+  void println(T v)
+  {
+    print(v);
+    println();
+  }
+  void println() { fputc('\n', stdout); }
+  void printf(const char *format, ...)
+  {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+  }
+};
+
+extern NativeSerial Serial;
+
+#endif
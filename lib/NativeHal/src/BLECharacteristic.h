@@ -0,0 +1,66 @@
+#ifndef NATIVE_BLE_CHARACTERISTIC_H
+#define NATIVE_BLE_CHARACTERISTIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define NATIVE_BLE_MAX_VALUE 512
+
+class BLECharacteristic;
+
+class BLECharacteristicCallbacks
+{
+public:
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onWrite(BLECharacteristic *pCharacteristic) {}
+};
+
+// Stand-in for one characteristic: write() plays the central writing to it,
+// notify() only counts, onNotify lets the host program capture what was sent.
+class BLECharacteristic
+{
+public:
+  static const uint32_t PROPERTY_READ = 1 << 0;
+  static const uint32_t PROPERTY_WRITE = 1 << 1;
+  static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+  static const uint32_t PROPERTY_WRITE_NR = 1 << 3;
+
+  typedef void (*NotifyHook)(const uint8_t *data, size_t length);
+
+  BLECharacteristic() : notifications(0), onNotify(NULL), length(0), callbacks(NULL) {}
+
+  void setCallbacks(BLECharacteristicCallbacks *cb) { callbacks = cb; }
+  void setValue(const uint8_t *data, size_t len)
+  {
+    length = len > NATIVE_BLE_MAX_VALUE ? NATIVE_BLE_MAX_VALUE : len;
+    memcpy(value, data, length);
+  }
+  uint8_t *getData() { return value; }
+  size_t getLength() { return length; }
+
+  void notify(bool is_notification = true)
+  {
+    notifications++;
+    if (onNotify)
+      onNotify(value, length);
+  }
+
+  // Host side: deliver a write from the central
+  void write(const uint8_t *data, size_t len)
+  {
+    setValue(data, len);
+    if (callbacks)
+      callbacks->onWrite(this);
+  }
+
+  uint32_t notifications;
+  NotifyHook onNotify;
+
+private:
+  uint8_t value[NATIVE_BLE_MAX_VALUE];
+  size_t length;
+  BLECharacteristicCallbacks *callbacks;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "NotifyScheduler.h"
+#include <string.h>
+
+NotifyScheduler::NotifyScheduler(uint32_t minPeriod)
+    : count(0), minPeriodUs(minPeriod), lastFlush(0), flushed(false),
+      mergedCount(0), replacedCount(0), overflowedCount(0), packetCount(0)
+{
+}
+
+void NotifyScheduler::post(const uint8_t *message, uint8_t length)
+{
+  if (length == 0 || length > NOTIFY_MAX_PAYLOAD + 1)
+    return;
+
+  Slot *slot = NULL;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (slots[i].data[0] == message[0])
+    {
+      slot = &slots[i];
+      replacedCount++;
+      break;
+    }
+  }
+  if (slot == NULL)
+  {
+    if (count >= NOTIFY_SLOTS)
+    {
+      overflowedCount++;
+      return;
+    }
+    slot = &slots[count++];
+  }
+  slot->length = length;
+  memcpy(slot->data, message, length);
+}
+
+size_t NotifyScheduler::poll(uint32_t nowUs, uint8_t *packet, size_t maxLength)
+{
+  if (count == 0)
+    return 0;
+  if (flushed && nowUs - lastFlush < minPeriodUs)
+    return 0;
+
+  size_t length = 0;
+  uint8_t sent = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (length + slots[i].length > maxLength)
+      break;
+    memcpy(packet + length, slots[i].data, slots[i].length);
+    length += slots[i].length;
+    sent++;
+  }
+
+  // whatever did not fit stays queued for the next packet
+  memmove(slots, slots + sent, (count - sent) * sizeof(Slot));
+  count -= sent;
+
+  if (sent > 1)
+    mergedCount += sent - 1;
+  if (sent > 0)
+  {
+    packetCount++;
+    lastFlush = nowUs;
+    flushed = true;
+  }
+  return length;
+}
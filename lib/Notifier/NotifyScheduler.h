@@ -0,0 +1,55 @@
+#ifndef NOTIFY_SCHEDULER_H
+#define NOTIFY_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NOTIFY_SLOTS 8
+#define NOTIFY_MAX_PAYLOAD 19 // a full OP_Pattern frame fits the default 23-byte MTU
+
+// Coalesces outbound messages into one notification per flush period.
+// Every opcode owns a single slot and only its latest value is kept: a step
+// position that was not sent before the next one arrives is stale and dropped.
+// Not thread safe, post() and poll() must come from the same task.
+class NotifyScheduler
+{
+public:
+  NotifyScheduler(uint32_t minPeriodUs);
+
+  // Shortest time between two packets, normally the connection interval
+  void setMinPeriod(uint32_t us) { minPeriodUs = us; }
+
+  // message = opcode followed by its payload, as it would be sent on its own
+  void post(const uint8_t *message, uint8_t length);
+
+  // Writes the pending messages back to back into packet if a flush is due.
+  // Returns the packet length, 0 if there is nothing to send yet.
+  size_t poll(uint32_t nowUs, uint8_t *packet, size_t maxLength);
+
+  bool pending() const { return count > 0; }
+  void clear() { count = 0; }
+
+  uint32_t merged() const { return mergedCount; }         // messages that shared a packet with another
+  uint32_t replaced() const { return replacedCount; }     // stale messages replaced by a newer one before being sent
+  uint32_t overflowed() const { return overflowedCount; } // messages lost because every slot was taken
+  uint32_t packets() const { return packetCount; }
+
+private:
+  struct Slot
+  {
+    uint8_t length;
+    uint8_t data[NOTIFY_MAX_PAYLOAD + 1];
+  };
+
+  Slot slots[NOTIFY_SLOTS];
+  uint8_t count;
+  uint32_t minPeriodUs;
+  uint32_t lastFlush;
+  bool flushed;
+  uint32_t mergedCount;
+  uint32_t replacedCount;
+  uint32_t overflowedCount;
+  uint32_t packetCount;
+};
+
+#endif
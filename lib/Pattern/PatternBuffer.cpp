@@ -0,0 +1,53 @@
+#include "PatternBuffer.h"
+#include <string.h>
+
+PatternBuffer::PatternBuffer() : front(0), pending(false), pendingAtBar(false)
+{
+  memset(steps, 0, sizeof(steps));
+}
+
+void PatternBuffer::load(const int *values, uint8_t count)
+{
+  if (count > MAX_STEPS)
+    count = MAX_STEPS;
+  for (uint8_t i = 0; i < count; i++)
+    set(i, values[i]);
+}
+
+void PatternBuffer::set(uint8_t step, int value)
+{
+  if (step >= MAX_STEPS)
+    return;
+  steps[0][step] = value;
+  steps[1][step] = value;
+}
+
+void PatternBuffer::setBack(uint8_t step, int value)
+{
+  if (step >= MAX_STEPS)
+    return;
+  steps[1 - front.load(std::memory_order_relaxed)][step] = value;
+}
+
+void PatternBuffer::requestCommit(bool atBar)
+{
+  pending = true;
+  pendingAtBar = atBar;
+}
+
+bool PatternBuffer::onStep(uint8_t stepIndex)
+{
+  if (!pending || (pendingAtBar && stepIndex != 0))
+    return false;
+  swap();
+  return true;
+}
+
+void PatternBuffer::swap()
+{
+  uint8_t newFront = 1 - front.load(std::memory_order_relaxed);
+  front.store(newFront, std::memory_order_release);
+  // the new back starts as a copy of what is playing, so edits are incremental
+  memcpy(steps[1 - newFront], steps[newFront], sizeof(steps[0]));
+  pending = false;
+}
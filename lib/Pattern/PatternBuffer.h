@@ -0,0 +1,43 @@
+#ifndef PATTERN_BUFFER_H
+#define PATTERN_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <Defs.h>
+
+// Front/back pattern storage. The sequencer plays the front buffer while edits
+// go to the back one; commit() swaps them by flipping a single index, so a
+// reader never sees half of an edit.
+class PatternBuffer
+{
+public:
+  PatternBuffer();
+
+  void load(const int *values, uint8_t count);
+
+  // Value played at a step
+  int get(uint8_t step) const { return steps[front.load(std::memory_order_acquire)][step]; }
+  const int *frontSteps() const { return steps[front.load(std::memory_order_acquire)]; }
+
+  // Live edit: applies to both buffers so the back copy stays in sync
+  void set(uint8_t step, int value);
+  // Staged edit: only becomes audible after a commit
+  void setBack(uint8_t step, int value);
+
+  // Arms a swap for the next step (atBar = false) or the next bar start (atBar = true)
+  void requestCommit(bool atBar);
+  bool commitPending() const { return pending; }
+
+  // Called by the sequencer before playing stepIndex; returns true if it swapped
+  bool onStep(uint8_t stepIndex);
+
+private:
+  void swap();
+
+  int steps[2][MAX_STEPS];
+  std::atomic<uint8_t> front;
+  bool pending;
+  bool pendingAtBar;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "Protocol.h"
+
+bool decodeCommand(const uint8_t *data, size_t length, Command &cmd)
+{
+  if (length < MSG_LENGTH)
+    return false;
+
+  cmd.op = data[0];
+  cmd.arg = data[1];
+  cmd.value = data[2];
+  cmd.at = 0;
+
+  switch (cmd.op)
+  {
+  case OP_Tempo:
+  case OP_PlayStop:
+  case OP_Route:
+  case OP_Calibrate:
+  case OP_Sync:
+  case OP_Ping:
+    return true;
+
+  case OP_Latency:
+    return cmd.arg <= LatencyOn;
+
+  case OP_Audio:
+    return cmd.arg <= AudioInterpolation;
+
+  case OP_TempoFine:
+    cmd.arg = 0;
+    cmd.value = data[1] | (data[2] << 8);
+    return cmd.value >= TEMPO_MIN_CENTI && cmd.value <= TEMPO_MAX_CENTI;
+
+  case OP_Note:
+  case OP_NoteBack:
+    return cmd.arg < MAX_STEPS;
+
+  case OP_Commit:
+    return cmd.arg == CommitStep || cmd.arg == CommitBar;
+
+  case OP_Clock:
+    return cmd.arg == ClockInternal || cmd.arg == ClockExternal || cmd.arg == ClockMidi;
+
+  case OP_ClockOut:
+    return cmd.arg == 0 || cmd.arg == 1 || cmd.arg == 2 || cmd.arg == 4 || cmd.arg == 24;
+
+  default:
+    return false;
+  }
+}
+
+// payload: start step, flags, one note per step
+static int decodePattern(const uint8_t *payload, size_t length, Command *out, size_t maxOut)
+{
+  if (length < 2)
+    return -1;
+  uint8_t start = payload[0];
+  uint8_t flags = payload[1];
+  size_t count = length - 2;
+  if (start >= MAX_STEPS || start + count > MAX_STEPS)
+    return -1;
+
+  size_t needed = count + ((flags & PatternCommit) ? 1 : 0);
+  if (needed > maxOut)
+    return -1;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    out[i].op = OP_NoteBack;
+    out[i].arg = start + i;
+    out[i].value = payload[2 + i];
+    out[i].at = 0;
+  }
+  if (flags & PatternCommit)
+  {
+    out[count].op = OP_Commit;
+    out[count].arg = (flags & PatternAtBar) ? CommitBar : CommitStep;
+    out[count].value = 0;
+    out[count].at = 0;
+  }
+  return needed;
+}
+
+// payload: device time (4 bytes LE), one fixed 3-byte message
+static bool decodeAt(const uint8_t *payload, size_t length, Command &cmd)
+{
+  if (length != AT_PAYLOAD_LENGTH || !decodeCommand(payload + 4, MSG_LENGTH, cmd) || cmd.op == OP_Sync ||
+      cmd.op == OP_Ping)
+    return false;
+  cmd.at = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+  // 0 means "on arrival", one us later is close enough
+  if (cmd.at == 0)
+    cmd.at = 1;
+  return true;
+}
+
+int decodeWrite(const uint8_t *data, size_t length, Command *out, size_t maxOut)
+{
+  size_t pos = 0;
+  size_t n = 0;
+
+  while (pos < length)
+  {
+    const uint8_t *frame = data + pos;
+    size_t remaining = length - pos;
+
+    if (frame[0] == OP_Pattern)
+    {
+      if (remaining < FRAME_HEADER_LENGTH || remaining - FRAME_HEADER_LENGTH < frame[1])
+        return -1;
+      int decoded = decodePattern(frame + FRAME_HEADER_LENGTH, frame[1], out + n, maxOut - n);
+      if (decoded < 0)
+        return -1;
+      n += decoded;
+      pos += FRAME_HEADER_LENGTH + frame[1];
+    }
+    else if (frame[0] == OP_At)
+    {
+      if (remaining < FRAME_HEADER_LENGTH || remaining - FRAME_HEADER_LENGTH < frame[1])
+        return -1;
+      if (n >= maxOut || !decodeAt(frame + FRAME_HEADER_LENGTH, frame[1], out[n]))
+        return -1;
+      n++;
+      pos += FRAME_HEADER_LENGTH + frame[1];
+    }
+    else
+    {
+      // padding or a cut off message after the last whole one, ignored like the
+      // original firmware ignored everything past the first message
+      if (remaining < MSG_LENGTH)
+        break;
+      if (n >= maxOut || !decodeCommand(frame, remaining, out[n]))
+        return -1;
+      n++;
+      pos += MSG_LENGTH;
+    }
+  }
+  return n;
+}
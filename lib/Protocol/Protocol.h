@@ -0,0 +1,33 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Defs.h>
+
+// Most commands a single write can expand to (a full OP_Pattern plus its commit, several times over)
+#define MAX_WRITE_COMMANDS 64
+
+// Decoded form of an inbound message, small enough to be copied through a queue
+struct Command
+{
+  uint8_t op;
+  uint8_t arg;
+  uint16_t value;
+  // device us (low 32 bits) to apply at, 0 = on arrival. For OP_Sync and OP_Ping: when it arrived.
+  uint32_t at;
+};
+
+// Decodes one fixed 3-byte message. Returns false for short or out of range messages.
+bool decodeCommand(const uint8_t *data, size_t length, Command &cmd);
+
+// Decodes a whole characteristic write, which may hold several frames: fixed
+// 3-byte messages and/or length-prefixed ones (OP_Pattern, OP_At). OP_Pattern
+// expands to one OP_NoteBack per step plus an optional OP_Commit, OP_At to
+// the message it carries with its time set.
+// Fewer than MSG_LENGTH bytes left after the last frame are ignored.
+// Returns the number of commands written to out, or -1 if any frame is malformed
+// or the write expands to more than maxOut commands; nothing is applied then.
+int decodeWrite(const uint8_t *data, size_t length, Command *out, size_t maxOut);
+
+#endif
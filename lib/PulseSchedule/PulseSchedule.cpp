@@ -0,0 +1,149 @@
+#include "PulseSchedule.h"
+
+PulseSchedule::PulseSchedule()
+    : rate(0), activeRate(0), widthUs(5000), started(false), stepsPerBeat(1), beatStep(0), stepDeadline(0),
+      stepPeriod(0), nextPulse(0), endPulse(0), nextRise(0), nextFall(0), fallDelay(0), high(false), pulseCount(0),
+      aheadArmed(false), aheadSent(false), aheadRise(0), aheadFallDelay(0)
+{
+}
+
+uint32_t PulseSchedule::fallDelayFor(uint32_t width, uint8_t ppqn, uint64_t period, uint8_t steps)
+{
+  // half the spacing between two pulses at most, so a pulse always falls before the next rises
+  uint32_t spacing = (period * steps / ppqn) >> 32;
+  uint32_t delay = width < spacing / 2 ? width : spacing / 2;
+  return delay > 0 ? delay : 1;
+}
+
+void PulseSchedule::onStep(int64_t deadline, uint64_t period, uint8_t steps)
+{
+  if (steps == 0)
+    steps = 1;
+  bool sent = aheadSent;
+  aheadArmed = false;
+  aheadSent = false;
+  if (!started || steps != stepsPerBeat)
+    beatStep = 0;
+  else
+    beatStep = (beatStep + 1) % steps;
+  started = true;
+  stepsPerBeat = steps;
+  stepDeadline = deadline;
+  stepPeriod = period;
+
+  if (beatStep == 0)
+  {
+    activeRate = rate;
+    if (activeRate > 0)
+      fallDelay = fallDelayFor(widthUs, activeRate, stepPeriod, stepsPerBeat);
+  }
+
+  if (activeRate == 0)
+  {
+    nextPulse = endPulse = 0;
+    return;
+  }
+  // pulse k belongs to the step that starts at or before it
+  nextPulse = (beatStep * activeRate + stepsPerBeat - 1) / stepsPerBeat;
+  endPulse = ((beatStep + 1) * activeRate + stepsPerBeat - 1) / stepsPerBeat;
+  // the pulse on the step start went out from expect() already
+  if (sent && nextPulse < endPulse && nextPulse * stepsPerBeat == beatStep * activeRate)
+    nextPulse++;
+  if (nextPulse < endPulse)
+    nextRise = pulseTime(nextPulse);
+}
+
+void PulseSchedule::expect(int64_t deadline, uint64_t period, uint8_t steps)
+{
+  if (aheadSent)
+    return;
+  aheadArmed = false;
+  if (steps == 0)
+    steps = 1;
+  uint8_t ppqn;
+  // what onStep() will make of the step: a beat start takes up the new rate
+  if (!started || steps != stepsPerBeat || (beatStep + 1) % steps == 0)
+  {
+    ppqn = rate;
+  }
+  else
+  {
+    ppqn = activeRate;
+    if (((beatStep + 1) * ppqn) % steps != 0)
+      return;
+  }
+  if (ppqn == 0)
+    return;
+  aheadFallDelay = fallDelayFor(widthUs, ppqn, period, steps);
+  aheadRise = deadline;
+  aheadArmed = true;
+}
+
+void PulseSchedule::moveExpected(int64_t deadline)
+{
+  int64_t halfStep = stepPeriod >> 33;
+  if (aheadArmed && deadline - aheadRise < halfStep && aheadRise - deadline < halfStep)
+    aheadRise = deadline;
+}
+
+void PulseSchedule::stop()
+{
+  started = false;
+  nextPulse = endPulse;
+  aheadArmed = false;
+  aheadSent = false;
+}
+
+int64_t PulseSchedule::pulseTime(uint32_t pulse) const
+{
+  // distance from the step start in 1/activeRate of a step, always below activeRate
+  uint32_t offset = pulse * stepsPerBeat - beatStep * activeRate;
+  return stepDeadline + (int64_t)((stepPeriod * offset / activeRate) >> 32);
+}
+
+uint8_t PulseSchedule::poll(int64_t now, int64_t &riseDeadline, int64_t &fallDeadline)
+{
+  uint8_t events = None;
+
+  if (high && now >= nextFall)
+  {
+    high = false;
+    fallDeadline = nextFall;
+    events |= Fall;
+  }
+
+  if (nextPulse < endPulse && now >= nextRise)
+  {
+    riseDeadline = nextRise;
+    nextFall = nextRise + fallDelay;
+    high = true;
+    pulseCount++;
+    events |= Rise;
+    nextPulse++;
+    if (nextPulse < endPulse)
+      nextRise = pulseTime(nextPulse);
+  }
+  else if (aheadArmed && nextPulse >= endPulse && now >= aheadRise)
+  {
+    riseDeadline = aheadRise;
+    nextFall = aheadRise + aheadFallDelay;
+    high = true;
+    pulseCount++;
+    events |= Rise;
+    aheadArmed = false;
+    aheadSent = true;
+  }
+  return events;
+}
+
+int64_t PulseSchedule::nextDeadline() const
+{
+  int64_t next = INT64_MAX;
+  if (high)
+    next = nextFall;
+  if (nextPulse < endPulse && nextRise < next)
+    next = nextRise;
+  else if (aheadArmed && nextPulse >= endPulse && aheadRise < next)
+    next = aheadRise;
+  return next;
+}
@@ -0,0 +1,83 @@
+#ifndef PULSE_SCHEDULE_H
+#define PULSE_SCHEDULE_H
+
+#include <stdint.h>
+
+// Clock output pulses derived from the step grid. Every step hands over its
+// deadline and 32.32 period (see StepSchedule) and the pulses that fall into
+// that step are placed at exact fractions of it, so the output stays phase
+// locked to the steps whatever the tempo source is (internal or followed).
+// Pulse k of a beat rises at beat start + k * beat / ppqn.
+//
+// The step callback comes late, so the pulse on a step start is placed one
+// step ahead: expect() announces the next step's deadline and poll() raises
+// that pulse on time; onStep() then leaves it out.
+//
+// Like StepSchedule it only does the bookkeeping; the caller fires a timer at
+// nextDeadline() and drives the pin from what poll() returns. No locking of
+// its own, ClockOut shares it with its timer interrupt under a spinlock.
+class PulseSchedule
+{
+public:
+  enum Event
+  {
+    None = 0,
+    Rise = 1 << 0,
+    Fall = 1 << 1
+  };
+
+  PulseSchedule();
+
+  // Pulses per quarter note, 0 = off. Takes effect at the next beat start.
+  void setRate(uint8_t ppqn) { rate = ppqn; }
+  uint8_t currentRate() const { return activeRate; }
+  // High time, shortened to half the pulse spacing at fast rates
+  void setWidth(uint32_t us) { widthUs = us; }
+
+  // Called at every step with the step's deadline. The first step after
+  // start or stop() is a beat start.
+  void onStep(int64_t deadline, uint64_t stepPeriod, uint8_t stepsPerBeat);
+  // The next step is due at deadline: places its first pulse if it starts
+  // with one. After onStep() with the following step, or before the first step.
+  void expect(int64_t deadline, uint64_t stepPeriod, uint8_t stepsPerBeat);
+  // The expected step moved (a followed clock pulled the grid), by less than half a step
+  void moveExpected(int64_t deadline);
+  // No more rising edges until the next onStep(); a pulse already high still falls
+  void stop();
+  bool running() const { return started; }
+
+  uint8_t poll(int64_t now, int64_t &riseDeadline, int64_t &fallDeadline);
+  // When the timer should fire next, INT64_MAX if nothing is pending
+  int64_t nextDeadline() const;
+
+  uint32_t pulses() const { return pulseCount; }
+
+private:
+  int64_t pulseTime(uint32_t pulse) const;
+  static uint32_t fallDelayFor(uint32_t widthUs, uint8_t ppqn, uint64_t stepPeriod, uint8_t stepsPerBeat);
+
+  volatile uint8_t rate;
+  uint8_t activeRate;
+  uint32_t widthUs;
+
+  bool started;
+  uint8_t stepsPerBeat;
+  uint8_t beatStep; // position of the current step within the beat
+  int64_t stepDeadline;
+  uint64_t stepPeriod;
+
+  uint32_t nextPulse; // pulses of the beat still to rise in this step: [nextPulse, endPulse)
+  uint32_t endPulse;
+  int64_t nextRise;
+  int64_t nextFall;
+  uint32_t fallDelay;
+  bool high;
+  uint32_t pulseCount;
+
+  bool aheadArmed; // the next step's first pulse is placed
+  bool aheadSent;  // and has risen already
+  int64_t aheadRise;
+  uint32_t aheadFallDelay;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "ImaAdpcm.h"
+
+static const int16_t stepTable[IMA_STEP_COUNT] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107,
+    118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894,
+    6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767};
+
+static const int8_t indexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static inline int32_t clamp(int32_t value, int32_t lo, int32_t hi)
+{
+  // compiles to min/max (cmov on the host, MIN/MAX on the Xtensa), no branches
+  value = value < lo ? lo : value;
+  return value > hi ? hi : value;
+}
+
+// One 4-bit code. The three magnitude bits select step, step/2 and step/4 on
+// top of step/8; masks instead of ifs keep the inner loop free of branches.
+static inline int16_t decodeNibble(uint32_t code, ImaState &s)
+{
+  int32_t step = stepTable[s.index];
+  int32_t diff = step >> 3;
+  diff += step & -(int32_t)((code >> 2) & 1);
+  diff += (step >> 1) & -(int32_t)((code >> 1) & 1);
+  diff += (step >> 2) & -(int32_t)(code & 1);
+  int32_t sign = -(int32_t)(code >> 3); // 0 or -1
+  s.predictor = clamp(s.predictor + ((diff ^ sign) - sign), INT16_MIN, INT16_MAX);
+  s.index = clamp(s.index + indexTable[code], 0, IMA_STEP_COUNT - 1);
+  return s.predictor;
+}
+
+size_t imaDecodeBlock(const uint8_t *block, size_t blockBytes, int16_t *out)
+{
+  if (blockBytes < IMA_BLOCK_HEADER)
+    return 0;
+  ImaState s;
+  s.predictor = (int16_t)(block[0] | (block[1] << 8));
+  s.index = clamp(block[2], 0, IMA_STEP_COUNT - 1);
+  out[0] = s.predictor;
+
+  int16_t *o = out + 1;
+  const uint8_t *p = block + IMA_BLOCK_HEADER;
+  const uint8_t *end = block + blockBytes;
+  while (p < end)
+  {
+    uint32_t b = *p++;
+    *o++ = decodeNibble(b & 0x0F, s);
+    *o++ = decodeNibble(b >> 4, s);
+  }
+  return o - out;
+}
+
+static uint32_t encodeSample(int32_t sample, ImaState &s)
+{
+  int32_t step = stepTable[s.index];
+  int32_t diff = sample - s.predictor;
+  uint32_t code = 0;
+  if (diff < 0)
+  {
+    code = 8;
+    diff = -diff;
+  }
+  if (diff >= step)
+  {
+    code |= 4;
+    diff -= step;
+  }
+  if (diff >= step >> 1)
+  {
+    code |= 2;
+    diff -= step >> 1;
+  }
+  if (diff >= step >> 2)
+    code |= 1;
+  // track the decoder exactly so errors do not accumulate
+  decodeNibble(code, s);
+  return code;
+}
+
+size_t imaEncodeBlock(const int16_t *in, size_t samples, ImaState &state, uint8_t *block, size_t blockBytes)
+{
+  size_t capacity = imaSamplesPerBlock(blockBytes);
+  if (samples > capacity)
+    samples = capacity;
+  if (samples == 0)
+    return 0;
+  state.predictor = in[0];
+  block[0] = (uint16_t)in[0] & 0xFF;
+  block[1] = (uint16_t)in[0] >> 8;
+  block[2] = state.index;
+  block[3] = 0;
+  size_t bytes = IMA_BLOCK_HEADER;
+  for (size_t i = 1; i < samples; i += 2)
+  {
+    // an odd sample out at the end is padded with itself
+    uint32_t lo = encodeSample(in[i], state);
+    uint32_t hi = encodeSample(in[i + 1 < samples ? i + 1 : i], state);
+    block[bytes++] = lo | (hi << 4);
+  }
+  return bytes;
+}
+
+void ImaCursor::start(const uint8_t *data, uint16_t align)
+{
+  blocks = data;
+  blockAlign = align;
+  perBlock = imaSamplesPerBlock(align);
+  // no block yet, the first read() loads one
+  position = blockStart = blockEnd = 0;
+}
+
+void ImaCursor::read(uint32_t from, int16_t *out, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t at = from + i;
+    if (at < position || at >= blockEnd)
+    {
+      uint32_t block = at / perBlock;
+      const uint8_t *header = blocks + block * blockAlign;
+      state.predictor = (int16_t)(header[0] | (header[1] << 8));
+      state.index = clamp(header[2], 0, IMA_STEP_COUNT - 1);
+      blockStart = position = block * perBlock;
+      blockEnd = blockStart + perBlock;
+      codes = header + IMA_BLOCK_HEADER;
+    }
+    // sample n of a block (n >= 1) comes from code n - 1
+    while (position < at)
+    {
+      uint32_t code = position - blockStart;
+      decodeNibble((code & 1) ? codes[code >> 1] >> 4 : codes[code >> 1] & 0x0F, state);
+      position++;
+    }
+    out[i] = state.predictor;
+  }
+}
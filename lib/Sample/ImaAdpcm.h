@@ -0,0 +1,63 @@
+#ifndef IMA_ADPCM_H
+#define IMA_ADPCM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IMA_BLOCK_HEADER 4   // predictor (int16 LE), step index, reserved
+#define IMA_STEP_COUNT 89
+
+// Mono IMA ADPCM as stored in WAV files (format 0x11): every block starts
+// with the predictor and step index, followed by 4-bit codes, low nibble first.
+// The first sample of a block is the predictor itself.
+struct ImaState
+{
+  int32_t predictor;
+  int32_t index;
+};
+
+inline uint16_t imaSamplesPerBlock(uint16_t blockAlign) { return (blockAlign - IMA_BLOCK_HEADER) * 2 + 1; }
+
+// Samples held in bytes of blocks, a short last block included
+inline uint32_t imaSampleCount(uint32_t bytes, uint16_t blockAlign)
+{
+  uint32_t rest = bytes % blockAlign;
+  return bytes / blockAlign * imaSamplesPerBlock(blockAlign) + (rest > IMA_BLOCK_HEADER ? imaSamplesPerBlock(rest) : 0);
+}
+
+// Decodes one block of blockBytes into out, which must hold
+// imaSamplesPerBlock(blockBytes) samples. A short last block decodes what it
+// holds. Returns the number of samples written.
+size_t imaDecodeBlock(const uint8_t *block, size_t blockBytes, int16_t *out);
+
+// Encodes up to imaSamplesPerBlock(blockBytes) samples into one block; the
+// state carries the step index over from the previous block. Fewer samples
+// make a short (last) block. Returns the bytes used. The firmware only
+// encodes to fade out a sample cut short (loadSample()).
+size_t imaEncodeBlock(const int16_t *in, size_t samples, ImaState &state, uint8_t *block, size_t blockBytes);
+
+// Reads samples out of IMA ADPCM blocks in memory without decoding them
+// all: keeps the decoder state of the last sample read, so reading on from
+// there decodes one nibble per sample. Reading backwards or in another block
+// starts over at that block's header, which holds its first sample.
+class ImaCursor
+{
+public:
+  ImaCursor() : blocks(NULL), blockAlign(0), perBlock(0), codes(NULL), position(0), blockStart(0), blockEnd(0) {}
+
+  void start(const uint8_t *data, uint16_t align);
+  // Writes samples from..from + count - 1 to out; they must be within the data.
+  void read(uint32_t from, int16_t *out, size_t count);
+
+private:
+  const uint8_t *blocks;
+  uint16_t blockAlign;
+  uint16_t perBlock;
+  const uint8_t *codes; // of the current block
+  ImaState state;       // state.predictor is the sample at position
+  uint32_t position;
+  uint32_t blockStart;  // first sample of the current block
+  uint32_t blockEnd;
+};
+
+#endif
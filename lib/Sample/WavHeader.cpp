@@ -0,0 +1,81 @@
+#include "WavHeader.h"
+#include <string.h>
+
+#include "ImaAdpcm.h"
+
+static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t le32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  put16(p, v & 0xFFFF);
+  put16(p + 2, v >> 16);
+}
+
+bool parseWavHeader(const uint8_t *data, size_t length, WavFormat &wav)
+{
+  if (length < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+    return false;
+
+  bool haveFormat = false;
+  size_t pos = 12;
+  while (pos + 8 <= length)
+  {
+    const uint8_t *chunk = data + pos;
+    uint32_t size = le32(chunk + 4);
+    if (memcmp(chunk, "fmt ", 4) == 0)
+    {
+      if (size < 16 || pos + 8 + size > length)
+        return false;
+      wav.format = le16(chunk + 8);
+      wav.channels = le16(chunk + 10);
+      wav.sampleRate = le32(chunk + 12);
+      wav.blockAlign = le16(chunk + 20);
+      wav.bitsPerSample = le16(chunk + 22);
+      wav.samplesPerBlock = 0;
+      // IMA ADPCM: cbSize, then samples per block
+      if (wav.format == WAV_FORMAT_IMA_ADPCM && size >= 20)
+        wav.samplesPerBlock = le16(chunk + 26);
+      haveFormat = true;
+    }
+    else if (memcmp(chunk, "data", 4) == 0)
+    {
+      wav.dataOffset = pos + 8;
+      wav.dataSize = size;
+      return haveFormat;
+    }
+    // chunks are padded to an even size
+    pos += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+size_t writeImaWavHeader(uint8_t *out, uint32_t sampleRate, uint16_t blockAlign, uint32_t samples,
+                         uint32_t dataSize)
+{
+  uint16_t samplesPerBlock = imaSamplesPerBlock(blockAlign);
+  memcpy(out, "RIFF", 4);
+  put32(out + 4, 52 + dataSize);
+  memcpy(out + 8, "WAVEfmt ", 8);
+  put32(out + 16, 20);
+  put16(out + 20, WAV_FORMAT_IMA_ADPCM);
+  put16(out + 22, 1);
+  put32(out + 24, sampleRate);
+  put32(out + 28, (uint32_t)((uint64_t)sampleRate * blockAlign / samplesPerBlock));
+  put16(out + 32, blockAlign);
+  put16(out + 34, 4);
+  put16(out + 36, 2);
+  put16(out + 38, samplesPerBlock);
+  memcpy(out + 40, "fact", 4);
+  put32(out + 44, 4);
+  put32(out + 48, samples);
+  memcpy(out + 52, "data", 4);
+  put32(out + 56, dataSize);
+  return 60;
+}
@@ -0,0 +1,31 @@
+#ifndef WAV_HEADER_H
+#define WAV_HEADER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IMA_ADPCM 0x0011
+#define WAV_HEADER_MAX 256 // read this much to find the data chunk of any file we write
+
+struct WavFormat
+{
+  uint16_t format; // WAV_FORMAT_*
+  uint16_t channels;
+  uint32_t sampleRate;
+  uint16_t bitsPerSample;
+  uint16_t blockAlign;      // bytes per block (IMA ADPCM) or per frame (PCM)
+  uint16_t samplesPerBlock; // IMA ADPCM only
+  uint32_t dataOffset;      // first byte of the data chunk
+  uint32_t dataSize;
+};
+
+// Walks the RIFF chunks in the first bytes of a file up to the data chunk.
+// Returns false if it is not a WAV file or the data chunk is not within length.
+bool parseWavHeader(const uint8_t *data, size_t length, WavFormat &wav);
+
+// Writes a 60-byte mono IMA ADPCM header (fmt with samples per block, fact, data)
+size_t writeImaWavHeader(uint8_t *out, uint32_t sampleRate, uint16_t blockAlign, uint32_t samples,
+                         uint32_t dataSize);
+
+#endif
@@ -0,0 +1,297 @@
+#include "Sequencer.h"
+
+const int defaultSequence[MAX_STEPS] = {
+    0,
+    0,
+    12,
+    12,
+    24,
+    24,
+    36,
+    36,
+    48,
+    48,
+    60,
+    60,
+    72,
+    72,
+    84,
+    84};
+
+Sequencer::Sequencer(Adafruit_MCP4728 &dac)
+    : subdivision(1), gatePercentage(1), mcp(dac), dropped(0), received(0), late(0), lastMicros(0), clockHigh(0), lastLead(0),
+      sink(NULL), extraHandler(NULL), stepHandler(NULL),
+      activeNotes(NULL), tempo(12000), play(false), gate(false), heldNote(NO_HELD_NOTE), muted(false), stepIndex(0)
+{
+}
+
+void Sequencer::begin(const int *pattern, NoteTable *notes, MessageSink messageSink)
+{
+  sequence.load(pattern, MAX_STEPS);
+  activeNotes = notes;
+  sink = messageSink;
+}
+
+bool Sequencer::receive(const uint8_t *data, size_t length)
+{
+  Command cmds[MAX_WRITE_COMMANDS];
+  int n = decodeWrite(data, length, cmds, MAX_WRITE_COMMANDS);
+  if (n <= 0)
+    return false;
+  received += n;
+  // all or nothing, a half loaded pattern followed by its commit would be worse than none
+  if (commandQueue.capacity() - commandQueue.size() < (size_t)n)
+  {
+    dropped += n;
+    return false;
+  }
+  uint32_t arrival = micros();
+  for (int i = 0; i < n; i++)
+  {
+    if (cmds[i].op == OP_Sync || cmds[i].op == OP_Ping)
+      cmds[i].at = arrival;
+    commandQueue.push(cmds[i]);
+  }
+  return true;
+}
+
+void Sequencer::send(uint8_t op, uint8_t value)
+{
+  if (sink == NULL)
+    return;
+  uint8_t message[2] = {op, value};
+  sink(message, sizeof(message));
+}
+
+int64_t Sequencer::now()
+{
+  uint32_t t = micros();
+  if (t < lastMicros)
+    clockHigh += (int64_t)1 << 32;
+  lastMicros = t;
+  return clockHigh + t;
+}
+
+// How far off the app's timing is: residual = applied - requested, lead = how
+// early the last timed command arrived (0 when it came too late to be on time)
+void Sequencer::sendSchedule(int32_t residual, int32_t lead)
+{
+  if (sink == NULL)
+    return;
+  if (residual > INT16_MAX)
+    residual = INT16_MAX;
+  else if (residual < INT16_MIN)
+    residual = INT16_MIN;
+  lead /= 1000;
+  if (lead < 0)
+    lead = 0;
+  else if (lead > UINT16_MAX)
+    lead = UINT16_MAX;
+  uint8_t message[6] = {OP_At, (uint8_t)(late > 255 ? 255 : late), (uint8_t)(residual & 0xFF),
+                        (uint8_t)((uint16_t)residual >> 8), (uint8_t)(lead & 0xFF), (uint8_t)(lead >> 8)};
+  sink(message, sizeof(message));
+}
+
+// Whole BPM for apps that only know OP_Tempo, then the exact value
+void Sequencer::sendTempo()
+{
+  uint32_t whole = tempo / 100;
+  send(OP_Tempo, whole > 255 ? 255 : whole);
+  if (sink == NULL)
+    return;
+  uint8_t message[MSG_LENGTH] = {OP_TempoFine, (uint8_t)(tempo & 0xFF), (uint8_t)(tempo >> 8)};
+  sink(message, sizeof(message));
+}
+
+uint32_t Sequencer::gateLength() const
+{
+  return stepInterval() * gatePercentage;
+}
+
+void Sequencer::setMuted(bool mute)
+{
+  muted = mute;
+  if (mute)
+    closeGate();
+}
+
+void Sequencer::gateOff()
+{
+  if (heldNote == NO_HELD_NOTE)
+    closeGate();
+}
+
+void Sequencer::closeGate()
+{
+  heldNote = NO_HELD_NOTE;
+  if (gate)
+  {
+    gate = false;
+    digitalWrite(GATE_PIN, LOW);
+  }
+}
+
+void Sequencer::playNote(uint8_t note)
+{
+  heldNote = NO_HELD_NOTE;
+  writeNote(note);
+}
+
+void Sequencer::holdNote(uint8_t note)
+{
+  heldNote = note;
+  writeNote(note);
+}
+
+void Sequencer::releaseNote(uint8_t note)
+{
+  if (heldNote == note)
+    closeGate();
+}
+
+void Sequencer::writeNote(uint8_t note)
+{
+  gate = true;
+  digitalWrite(GATE_PIN, HIGH);
+  if (note >= NOTE_COUNT)
+    note = NOTE_COUNT - 1;
+  const NoteCode &code = activeNotes->notes[note];
+  // one I2C transaction for both CV channels, A and B stay at 0
+  mcp.fastWrite(0, 0, code.c, code.d);
+}
+
+// Only ever runs between steps on the sequencer task, so commands never race with a step in progress
+void Sequencer::drain()
+{
+  int64_t t = now();
+  Command cmd;
+  while (commandQueue.pop(cmd))
+  {
+    if (cmd.at == 0 || cmd.op == OP_Sync || cmd.op == OP_Ping)
+    {
+      applyCommand(cmd);
+      continue;
+    }
+    // nearest point in time with these low 32 bits
+    int64_t at = t + (int32_t)(cmd.at - (uint32_t)t);
+    lastLead = at - t;
+    if (at <= t || !scheduled.push(at, cmd))
+    {
+      if (t - at > SCHEDULE_LATE_US)
+        late++;
+      applyCommand(cmd);
+      sendSchedule(t - at, lastLead);
+    }
+  }
+
+  int64_t at;
+  while (scheduled.popDue(t, cmd, at))
+  {
+    if (t - at > SCHEDULE_LATE_US)
+      late++;
+    applyCommand(cmd);
+    sendSchedule(t - at, lastLead);
+  }
+}
+
+int64_t Sequencer::untilDue()
+{
+  int64_t next = scheduled.nextTime();
+  return next == INT64_MAX ? next : next - now();
+}
+
+void Sequencer::step()
+{
+  drain();
+  sequence.onStep(stepIndex);
+
+  if (!play)
+    return;
+  if (!muted)
+  {
+    uint8_t note = sequence.get(stepIndex);
+    playNote(note);
+    if (stepHandler)
+      stepHandler(stepIndex, note);
+  }
+  send(OP_Step, stepIndex);
+  stepIndex++;
+  if (stepIndex >= MAX_STEPS)
+    stepIndex = 0;
+}
+
+void Sequencer::applyCommand(const Command &cmd)
+{
+  switch (cmd.op)
+  {
+  case OP_Tempo:
+    tempo = (cmd.arg + 1) * 100;
+    sendTempo();
+    break;
+
+  case OP_TempoFine:
+    tempo = cmd.value;
+    sendTempo();
+    break;
+
+  case OP_PlayStop:
+    if (cmd.arg == Play)
+    {
+      play = true;
+    }
+    else if (cmd.arg == Pause)
+    {
+      play = false;
+    }
+    else
+    {
+      play = false;
+      stepIndex = 0;
+    }
+    break;
+
+  case OP_Note:
+    sequence.set(cmd.arg, cmd.value);
+    break;
+
+  case OP_NoteBack:
+    sequence.setBack(cmd.arg, cmd.value);
+    break;
+
+  case OP_Commit:
+    sequence.requestCommit(cmd.arg == CommitBar);
+    break;
+
+  case OP_Route:
+    switch (cmd.arg)
+    {
+    case Square:
+      digitalWrite(SQUARE_GATE_PIN, HIGH);
+      break;
+    case Gate:
+      digitalWrite(SQUARE_GATE_PIN, LOW);
+      break;
+    case Sub:
+      digitalWrite(SUB_SEQ_PIN, HIGH);
+      break;
+    case Seq:
+      digitalWrite(SUB_SEQ_PIN, LOW);
+      break;
+    case A_out:
+      digitalWrite(ANALOG_DIGITAL_PIN, HIGH);
+      break;
+    case D_out:
+      digitalWrite(ANALOG_DIGITAL_PIN, LOW);
+      break;
+
+    default:
+      break;
+    }
+    break;
+
+  default:
+    if (extraHandler)
+      extraHandler(cmd);
+    break;
+  }
+}
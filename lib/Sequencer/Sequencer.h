@@ -0,0 +1,127 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <Arduino.h>
+#include <Adafruit_MCP4728.h>
+#include <Defs.h>
+#include <Protocol.h>
+#include <SpscQueue.h>
+#include <PatternBuffer.h>
+#include <NoteTable.h>
+#include <StepSchedule.h>
+#include <TimedQueue.h>
+
+#define COMMAND_QUEUE_SIZE 128
+#define SCHEDULED_QUEUE_SIZE 64
+#define SCHEDULE_LATE_US 1000 // a timed command applied later than this counts as late
+
+// Pattern loaded at boot, note numbers (12 per volt)
+extern const int defaultSequence[MAX_STEPS];
+
+// Hardware independent part of the firmware: command handling, pattern playback
+// and gate/CV output. It only talks to the outside through digitalWrite(), the
+// MCP4728 and the callbacks below, so the same code runs on the ESP32 and in the
+// native build against stand-ins.
+//
+// Threading: receive() is the producer side (BLE task), everything else runs
+// on the sequencer task. State getters may be read from anywhere.
+class Sequencer
+{
+public:
+  typedef void (*MessageSink)(const uint8_t *data, uint8_t length);
+  typedef void (*CommandHandler)(const Command &cmd);
+  typedef void (*StepHandler)(uint8_t step, uint8_t note);
+
+  Sequencer(Adafruit_MCP4728 &dac);
+
+  void begin(const int *pattern, NoteTable *notes, MessageSink sink);
+  // Commands the sequencer does not know about (e.g. OP_Calibrate, OP_Sync and
+  // OP_Ping with their arrival time in at) go here
+  void setCommandHandler(CommandHandler handler) { extraHandler = handler; }
+  // Called on the sequencer task for every step that plays a note (e.g. sample voices)
+  void setStepHandler(StepHandler handler) { stepHandler = handler; }
+
+  // BLE task: decode a write and queue it, all or nothing
+  bool receive(const uint8_t *data, size_t length);
+  uint32_t droppedCommands() const { return dropped; }
+  uint32_t receivedCommands() const { return received; }
+
+  // Sequencer task
+  // Applies queued commands and the timed ones (OP_At) that are due; called by
+  // step() and whenever the BLE task signals new ones or a timed one is due
+  void drain();
+  // us until the next timed command is due, INT64_MAX if there is none
+  int64_t untilDue();
+  void step();
+  // End of a step's gate. Leaves a held note alone.
+  void gateOff();
+  void applyCommand(const Command &cmd);
+  // Opens the gate for the length of a step; gateOff() closes it
+  void playNote(uint8_t note);
+  // Opens the gate until releaseNote() with the same note (MIDI Note On/Off).
+  // A step that plays meanwhile takes the gate over and ends it as usual.
+  void holdNote(uint8_t note);
+  void releaseNote(uint8_t note);
+  // Next step is the first of the pattern (external reset input)
+  void rewind() { stepIndex = 0; }
+
+  // Muted steps still advance but do not touch the gate or the DAC
+  void setMuted(bool mute);
+  void setNoteTable(NoteTable *notes) { activeNotes = notes; }
+  NoteTable *noteTable() const { return activeNotes; }
+
+  // Step length for the current tempo and subdivision, 32.32 fixed point us
+  // (see StepSchedule). stepInterval() is its whole us part.
+  uint64_t stepPeriod() const { return StepSchedule::periodFor(tempo, subdivision); }
+  uint32_t stepInterval() const { return stepPeriod() >> 32; }
+  uint32_t gateLength() const;
+
+  int bpm() const { return tempo / 100; }
+  uint32_t centiBpm() const { return tempo; }
+  uint32_t lateCommands() const { return late; }
+  bool playing() const { return play; }
+  bool gateOpen() const { return gate; }
+  bool noteHeld() const { return heldNote != NO_HELD_NOTE; }
+  uint8_t position() const { return stepIndex; }
+  uint8_t transport() const { return play ? Play : (stepIndex == 0 ? Stop : Pause); }
+  const PatternBuffer &pattern() const { return sequence; }
+
+  // steps per beat: 1 = quarter notes, 2 = eighths, 4 = sixteenths
+  uint8_t subdivision;
+  int gatePercentage; //percentage of interval
+
+private:
+  static const uint8_t NO_HELD_NOTE = 0xFF;
+
+  void writeNote(uint8_t note);
+  void closeGate();
+  void send(uint8_t op, uint8_t value);
+  void sendTempo();
+  void sendSchedule(int32_t residual, int32_t lead);
+  // micros() extended to 64 bits, sequencer task only
+  int64_t now();
+
+  Adafruit_MCP4728 &mcp;
+  SpscQueue<Command, COMMAND_QUEUE_SIZE> commandQueue; // BLE host task -> sequencer
+  TimedQueue<Command, SCHEDULED_QUEUE_SIZE> scheduled; // sequencer task
+  volatile uint32_t dropped;
+  volatile uint32_t received;
+  volatile uint32_t late;
+  uint32_t lastMicros;
+  int64_t clockHigh;
+  int32_t lastLead;
+  MessageSink sink;
+  CommandHandler extraHandler;
+  StepHandler stepHandler;
+  PatternBuffer sequence;
+  NoteTable *volatile activeNotes;
+
+  volatile uint32_t tempo; // 1/100 BPM
+  volatile bool play;
+  volatile bool gate;
+  volatile uint8_t heldNote; // note holding the gate, NO_HELD_NOTE if a step (or nothing) opened it
+  volatile bool muted;
+  volatile uint8_t stepIndex;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Wait-free single-producer/single-consumer ring.
+// One task may call push(), one other task may call pop(); neither ever blocks.
+// Size must be a power of two; one slot is never used so full != empty.
+template <typename T, size_t Size>
+class SpscQueue
+{
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  bool push(const T &item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t next = (h + 1) & (Size - 1);
+    if (next == tail.load(std::memory_order_acquire))
+      return false; // full
+    buffer[h] = item;
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+      return false; // empty
+    item = buffer[t];
+    tail.store((t + 1) & (Size - 1), std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const
+  {
+    return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+  }
+
+  // Exact for the consumer, a lower bound of free space seen from the producer
+  size_t size() const
+  {
+    return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (Size - 1);
+  }
+
+  size_t capacity() const { return Size - 1; }
+
+private:
+  T buffer[Size];
+  std::atomic<size_t> head; // written by producer
+  std::atomic<size_t> tail; // written by consumer
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "StepSchedule.h"
+
+// 100 * 60 s in us, the numerator of every tempo period
+#define CENTI_MINUTE_US 6000000000ULL
+
+StepSchedule::StepSchedule()
+    : periodUs(500000), periodFraction(0), gateUs(500000), nextStep(0), phase(0), nextGateOff(0),
+      gatePending(false), skippedSteps(0)
+{
+}
+
+uint64_t StepSchedule::periodFor(uint32_t centiBpm, uint8_t stepsPerBeat)
+{
+  uint64_t divisor = (uint64_t)centiBpm * (stepsPerBeat ? stepsPerBeat : 1);
+  if (divisor == 0)
+    divisor = 1;
+  uint64_t whole = CENTI_MINUTE_US / divisor;
+  // the remainder is below the divisor, so shifting it by 32 cannot overflow
+  uint64_t fraction = ((CENTI_MINUTE_US % divisor) << 32) / divisor;
+  return (whole << 32) | fraction;
+}
+
+void StepSchedule::start(int64_t now)
+{
+  nextStep = now;
+  phase = 0;
+  advance(1);
+  gatePending = false;
+}
+
+void StepSchedule::setPeriod(uint64_t period, uint32_t gate)
+{
+  uint32_t whole = period >> 32;
+  if (whole == 0)
+  {
+    whole = 1;
+    period = (uint64_t)1 << 32;
+  }
+  if (gate > whole)
+    gate = whole;
+  periodUs = whole;
+  periodFraction = (uint32_t)period;
+  gateUs = gate;
+}
+
+void StepSchedule::advance(uint32_t steps)
+{
+  uint64_t fraction = (uint64_t)phase + (uint64_t)periodFraction * steps;
+  phase = (uint32_t)fraction;
+  nextStep += (int64_t)periodUs * steps + (int64_t)(fraction >> 32);
+}
+
+void StepSchedule::align(int64_t anchor)
+{
+  int64_t ahead = nextStep - anchor;
+  uint32_t steps = ahead > 0 ? (ahead + periodUs / 2) / periodUs : 0;
+  // steps == 0: the pulse came before the step it belongs to, which then fires right away
+  nextStep = anchor;
+  phase = 0;
+  advance(steps);
+}
+
+uint8_t StepSchedule::poll(int64_t now, int64_t &stepDeadline, int64_t &gateDeadline)
+{
+  uint8_t events = None;
+
+  // gate off goes first so a 100% gate closes right before the next step opens it
+  if (gatePending && now >= nextGateOff)
+  {
+    gatePending = false;
+    gateDeadline = nextGateOff;
+    events |= GateOff;
+  }
+
+  if (now >= nextStep)
+  {
+    int64_t scheduled = nextStep;
+    nextGateOff = scheduled + gateUs;
+    gatePending = true;
+    advance(1);
+    // if we fell more than a whole step behind, skip ahead on the grid instead of bursting
+    if (nextStep <= now)
+    {
+      uint32_t behind = (now - nextStep) / periodUs + 1;
+      skippedSteps += behind;
+      advance(behind);
+    }
+    stepDeadline = scheduled;
+    events |= Step;
+  }
+  return events;
+}
+
+int64_t StepSchedule::nextDeadline() const
+{
+  if (gatePending && nextGateOff < nextStep)
+    return nextGateOff;
+  return nextStep;
+}
@@ -0,0 +1,65 @@
+#ifndef STEP_SCHEDULE_H
+#define STEP_SCHEDULE_H
+
+#include <stdint.h>
+
+// Deadline bookkeeping behind StepClock, kept free of esp_timer so the native
+// simulator runs exactly the same logic. Times are absolute microseconds.
+// Steps are placed on a fixed grid (previous deadline + interval), never
+// relative to when the timer actually fired, so lateness does not accumulate.
+//
+// The step period is 32.32 fixed point microseconds. The fractional part is
+// carried from step to step, so a period of 112781.95 us (133 BPM) puts step
+// n at n * 112781.95 us rounded down, instead of drifting 0.95 us per step.
+class StepSchedule
+{
+public:
+  enum Event
+  {
+    None = 0,
+    Step = 1 << 0,
+    GateOff = 1 << 1
+  };
+
+  StepSchedule();
+
+  // 32.32 step period for a tempo in 1/100 BPM, integer math only
+  static uint64_t periodFor(uint32_t centiBpm, uint8_t stepsPerBeat);
+
+  void start(int64_t now);
+  // Take effect from the next step on
+  void setPeriod(uint64_t period, uint32_t gateUs);
+  void setInterval(uint32_t intervalUs, uint32_t gateUs) { setPeriod((uint64_t)intervalUs << 32, gateUs); }
+  uint64_t period() const { return ((uint64_t)periodUs << 32) | periodFraction; }
+  uint32_t interval() const { return periodUs; }
+
+  // Shifts the grid so it passes through anchor, keeping the pending step
+  // (the step nearest to where it was). Used to follow an external clock.
+  void align(int64_t anchor);
+
+  // Handles every deadline that is due at now. Returns the Event bits that
+  // fired and the deadline each one was scheduled for.
+  uint8_t poll(int64_t now, int64_t &stepDeadline, int64_t &gateDeadline);
+
+  // When the timer should fire next
+  int64_t nextDeadline() const;
+  // When the next step is due, gate offs left out
+  int64_t nextStepDeadline() const { return nextStep; }
+
+  // Steps skipped because the caller was more than a whole interval late
+  uint32_t skipped() const { return skippedSteps; }
+
+private:
+  void advance(uint32_t steps);
+
+  uint32_t periodUs;
+  uint32_t periodFraction; // 1/2^32 us
+  uint32_t gateUs;
+  int64_t nextStep;
+  uint32_t phase; // fraction of a us nextStep is behind the exact grid
+  int64_t nextGateOff;
+  bool gatePending;
+  uint32_t skippedSteps;
+};
+
+#endif
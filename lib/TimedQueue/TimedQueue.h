@@ -0,0 +1,61 @@
+#ifndef TIMED_QUEUE_H
+#define TIMED_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed size queue ordered by due time (absolute us). Items due at the same
+// time come out in the order they were pushed. Not thread safe: one task
+// pushes and pops, other tasks hand items over through an SpscQueue.
+template <typename T, size_t Size>
+class TimedQueue
+{
+public:
+  TimedQueue() : count(0) {}
+
+  // False when full
+  bool push(int64_t at, const T &item)
+  {
+    if (count >= Size)
+      return false;
+    // kept latest first so the next item is always at the end
+    size_t i = count;
+    while (i > 0 && entries[i - 1].at <= at)
+    {
+      entries[i] = entries[i - 1];
+      i--;
+    }
+    entries[i].at = at;
+    entries[i].item = item;
+    count++;
+    return true;
+  }
+
+  // Takes the earliest item if it is due at now
+  bool popDue(int64_t now, T &item, int64_t &at)
+  {
+    if (count == 0 || entries[count - 1].at > now)
+      return false;
+    count--;
+    at = entries[count].at;
+    item = entries[count].item;
+    return true;
+  }
+
+  // INT64_MAX when empty
+  int64_t nextTime() const { return count > 0 ? entries[count - 1].at : INT64_MAX; }
+  size_t size() const { return count; }
+  void clear() { count = 0; }
+
+private:
+  struct Entry
+  {
+    int64_t at;
+    T item;
+  };
+
+  Entry entries[Size];
+  size_t count;
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "VoiceMixer.h"
+#include <string.h>
+
+// 2^(i/12) in 16.16
+static const uint32_t semitoneRatio[12] = {65536, 69433, 73562, 77936, 82570, 87480,
+                                           92682, 98193, 104032, 110218, 116772, 123715};
+
+VoiceMixer::VoiceMixer()
+    : interpolation(Linear), triggerCount(0), stolenCount(0)
+{
+  stopAll();
+}
+
+void VoiceMixer::stopAll()
+{
+  for (uint8_t i = 0; i < VOICE_COUNT; i++)
+    voices[i].active = false;
+}
+
+uint32_t VoiceMixer::pitchIncrement(int semitones)
+{
+  int octave = semitones >= 0 ? semitones / 12 : -((11 - semitones) / 12);
+  uint32_t ratio = semitoneRatio[semitones - octave * 12];
+  if (octave >= 0)
+    return octave > 8 ? ratio << 8 : ratio << octave;
+  return -octave > 16 ? 0 : ratio >> -octave;
+}
+
+uint8_t VoiceMixer::trigger(const Sample &sample, uint16_t gain, uint32_t increment)
+{
+  uint8_t chosen = 0;
+  bool free = false;
+  for (uint8_t i = 0; i < VOICE_COUNT; i++)
+  {
+    if (!voices[i].active)
+    {
+      chosen = i;
+      free = true;
+      break;
+    }
+    if (voices[i].age < voices[chosen].age)
+      chosen = i;
+  }
+  if (!free)
+    stolenCount++;
+
+  Voice &v = voices[chosen];
+  v.data = sample.data;
+  v.length = sample.length;
+  v.phase = 0;
+  v.increment = increment;
+  v.gain = gain;
+  v.age = triggerCount++;
+  v.active = (sample.data != NULL || sample.blocks != NULL) && sample.length > 0 && increment > 0;
+  v.blocks = sample.data == NULL ? sample.blocks : NULL;
+  if (v.blocks != NULL)
+  {
+    v.cursor.start(sample.blocks, sample.blockAlign);
+    v.windowStart = v.windowLength = v.windowEnd = 0;
+  }
+  return chosen;
+}
+
+uint8_t VoiceMixer::active() const
+{
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < VOICE_COUNT; i++)
+    n += voices[i].active;
+  return n;
+}
+
+// Interpolators: p points at the sample below the phase, t is the fraction in Q15
+
+static inline int32_t nearest(const int16_t *p, int32_t)
+{
+  return p[0];
+}
+
+static inline int32_t linear(const int16_t *p, int32_t t)
+{
+  return p[0] + (((p[1] - p[0]) * t) >> 15);
+}
+
+// Catmull-Rom in the 4 multiply form (de Soras). The cubic terms need more
+// than 32 bits, and the curve can overshoot full scale between samples.
+static inline int32_t hermite(const int16_t *p, int32_t t)
+{
+  int32_t c = (p[1] - p[-1]) >> 1;
+  int32_t v = p[0] - p[1];
+  int32_t w = c + v;
+  int32_t a = w + v + ((p[2] - p[0]) >> 1);
+  int32_t b = w + a;
+  int32_t y = (int32_t)(((int64_t)a * t) >> 15) - b;
+  y = (int32_t)(((int64_t)y * t) >> 15) + c;
+  y = p[0] + (int32_t)(((int64_t)y * t) >> 15);
+  y = y < INT16_MIN ? INT16_MIN : y;
+  return y > INT16_MAX ? INT16_MAX : y;
+}
+
+// Mixes frames of one voice through an interpolator that reads Before samples
+// behind and After ahead of the phase. Frames whose taps are all inside the
+// sample run in a tight loop; the few at either end read a copy of the taps
+// with the first or last sample repeated. Returns the new phase.
+template <int32_t (*Interpolate)(const int16_t *, int32_t), uint32_t Before, uint32_t After>
+static uint64_t mixVoice(const int16_t *data, uint32_t length, uint64_t phase, uint32_t increment, int32_t gain,
+                         int32_t *acc, size_t frames)
+{
+  uint64_t inside = length > After ? (uint64_t)(length - After) << 16 : 0;
+  size_t i = 0;
+  while (i < frames)
+  {
+    uint32_t index = phase >> 16;
+    if (index >= Before && phase < inside)
+    {
+      uint64_t run = (inside - phase + increment - 1) / increment;
+      size_t end = run < frames - i ? i + (size_t)run : frames;
+      for (; i < end; i++)
+      {
+        acc[i] += (Interpolate(data + (phase >> 16), (phase & 0xFFFF) >> 1) * gain) >> 15;
+        phase += increment;
+      }
+      continue;
+    }
+    int16_t taps[Before + 1 + After];
+    for (uint32_t k = 0; k < Before + 1 + After; k++)
+    {
+      int64_t at = (int64_t)index - Before + k;
+      taps[k] = data[at < 0 ? 0 : (at >= length ? length - 1 : at)];
+    }
+    acc[i++] += (Interpolate(taps + Before, (phase & 0xFFFF) >> 1) * gain) >> 15;
+    phase += increment;
+  }
+  return phase;
+}
+
+static uint64_t mixInterpolated(VoiceMixer::Interpolation mode, const int16_t *data, uint32_t length, uint64_t phase,
+                                uint32_t increment, int32_t gain, int32_t *acc, size_t frames)
+{
+  switch (mode)
+  {
+  case VoiceMixer::Linear:
+    return mixVoice<linear, 0, 1>(data, length, phase, increment, gain, acc, frames);
+  case VoiceMixer::Hermite:
+    return mixVoice<hermite, 1, 2>(data, length, phase, increment, gain, acc, frames);
+  default:
+    return mixVoice<nearest, 0, 0>(data, length, phase, increment, gain, acc, frames);
+  }
+}
+
+void VoiceMixer::render(Voice &v, int32_t *acc, size_t frames)
+{
+  // frames left before the phase runs off the end
+  uint64_t end = (uint64_t)v.length << 16;
+  uint64_t left = (end - v.phase + v.increment - 1) / v.increment;
+  size_t n = left < frames ? (size_t)left : frames;
+
+  if (v.blocks != NULL)
+    renderBlocks(v, acc, n);
+  else
+    v.phase = mixInterpolated(interpolation, v.data, v.length, v.phase, v.increment, v.gain, acc, n);
+  if (v.phase >= end)
+    v.active = false;
+}
+
+// Decodes the window from the sample before index on, taking over what the
+// last window already holds. Inside the sample the last two samples of a
+// window are only there as taps (Hermite reads one behind and two ahead);
+// a window that reaches the end of the sample repeats the last sample like
+// mixVoice() does for PCM.
+void VoiceMixer::refill(Voice &v, uint32_t index)
+{
+  uint32_t first = index > 0 ? index - 1 : 0;
+  uint32_t length = v.length - first < VOICE_WINDOW ? v.length - first : VOICE_WINDOW;
+  uint32_t kept = 0;
+  if (first >= v.windowStart && first < v.windowStart + v.windowLength)
+  {
+    kept = v.windowStart + v.windowLength - first;
+    kept = kept < length ? kept : length;
+    memmove(v.window, v.window + (first - v.windowStart), kept * sizeof(int16_t));
+  }
+  v.cursor.read(first + kept, v.window + kept, length - kept);
+  v.windowStart = first;
+  v.windowLength = length;
+  v.windowEnd = first + length == v.length ? v.length : first + length - 2;
+}
+
+void VoiceMixer::renderBlocks(Voice &v, int32_t *acc, size_t frames)
+{
+  while (frames > 0)
+  {
+    uint32_t index = v.phase >> 16;
+    if (index >= v.windowEnd)
+      refill(v, index);
+    uint64_t stop = (uint64_t)v.windowEnd << 16;
+    uint64_t left = (stop - v.phase + v.increment - 1) / v.increment;
+    size_t n = left < frames ? (size_t)left : frames;
+    uint64_t offset = (uint64_t)v.windowStart << 16;
+    v.phase = mixInterpolated(interpolation, v.window, v.windowLength, v.phase - offset, v.increment, v.gain, acc, n) +
+              offset;
+    acc += n;
+    frames -= n;
+  }
+}
+
+void VoiceMixer::mix(int16_t *out, size_t frames)
+{
+  if (frames > MIX_BLOCK_MAX)
+    frames = MIX_BLOCK_MAX;
+  int32_t acc[MIX_BLOCK_MAX];
+  for (size_t i = 0; i < frames; i++)
+    acc[i] = 0;
+
+  for (uint8_t i = 0; i < VOICE_COUNT; i++)
+  {
+    if (voices[i].active)
+      render(voices[i], acc, frames);
+  }
+
+  for (size_t i = 0; i < frames; i++)
+  {
+    int32_t s = acc[i];
+    s = s < INT16_MIN ? INT16_MIN : s;
+    out[i] = s > INT16_MAX ? INT16_MAX : s;
+  }
+}
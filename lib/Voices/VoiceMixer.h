@@ -0,0 +1,101 @@
+#ifndef VOICE_MIXER_H
+#define VOICE_MIXER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ImaAdpcm.h>
+
+#define VOICE_COUNT 8
+#define MIX_BLOCK_MAX 128 // frames per mix() call at most
+#define VOICE_UNITY_GAIN 32768 // Q15
+#define PITCH_UNITY 65536 // 16.16 source samples per output sample
+#define VOICE_WINDOW 64 // samples an IMA ADPCM voice decodes ahead
+
+// A sample in RAM, mono: 16-bit PCM in data, or IMA ADPCM blocks of
+// blockAlign bytes in blocks (data NULL), about 4x smaller
+struct Sample
+{
+  const int16_t *data;
+  uint32_t length; // samples
+  const uint8_t *blocks;
+  uint16_t blockAlign;
+};
+
+// Fixed point polyphonic sample player. Every voice walks its sample with a
+// 48.16 phase accumulator, reads it at the phase with the chosen
+// interpolation and adds sample * gain (Q15) into a 32-bit block
+// accumulator; the block is saturated to 16 bits once at the end, so voices
+// can overlap without wrapping. Works in blocks of up to MIX_BLOCK_MAX frames
+// to keep the per call overhead (voice setup, end checks) off the per sample path.
+// An IMA ADPCM voice decodes the part of its block it is about to play into a
+// window of VOICE_WINDOW samples and mixes from there, so it sounds exactly
+// like the decoded sample played as PCM.
+//
+// When all voices are busy the oldest one is cut and reused (stolen()).
+// Not thread safe, one task triggers and mixes.
+class VoiceMixer
+{
+public:
+  // How a voice reads between samples when it is repitched:
+  // Nearest takes the sample below the phase (aliases and adds phase noise),
+  // Linear weighs the two around it, Hermite fits a 4-point cubic (Catmull-Rom).
+  // All of them play the sample exactly at whole sample positions. The values
+  // are the ones OP_Audio sends.
+  enum Interpolation : uint8_t
+  {
+    Nearest,
+    Linear,
+    Hermite
+  };
+
+  VoiceMixer();
+
+  // Starts sample on a free voice, or on the oldest one. increment is in
+  // 16.16 source samples per output frame (PITCH_UNITY = original pitch).
+  // Returns the voice used.
+  uint8_t trigger(const Sample &sample, uint16_t gain, uint32_t increment);
+  void stopAll();
+  // Applies from the next mix()
+  void setInterpolation(Interpolation mode) { interpolation = mode; }
+  Interpolation interpolationMode() const { return interpolation; }
+
+  // Mixes frames (<= MIX_BLOCK_MAX) mono frames into out
+  void mix(int16_t *out, size_t frames);
+
+  uint8_t active() const;
+  uint32_t stolen() const { return stolenCount; }
+  uint32_t triggered() const { return triggerCount; }
+
+  // Increment for a pitch shift in semitones, equal temperament
+  static uint32_t pitchIncrement(int semitones);
+
+private:
+  struct Voice
+  {
+    const int16_t *data;
+    uint32_t length;
+    uint64_t phase; // 48.16
+    uint32_t increment;
+    uint16_t gain;
+    uint32_t age; // trigger number, the smallest is the oldest
+    bool active;
+    // IMA ADPCM only
+    const uint8_t *blocks;
+    ImaCursor cursor;
+    int16_t window[VOICE_WINDOW]; // samples windowStart..windowStart + windowLength - 1
+    uint32_t windowStart;
+    uint32_t windowLength;
+    uint32_t windowEnd; // the window holds every tap up to this sample position
+  };
+
+  void render(Voice &v, int32_t *acc, size_t frames);
+  void renderBlocks(Voice &v, int32_t *acc, size_t frames);
+  void refill(Voice &v, uint32_t index);
+
+  Voice voices[VOICE_COUNT];
+  Interpolation interpolation;
+  uint32_t triggerCount;
+  uint32_t stolenCount;
+};
+
+#endif
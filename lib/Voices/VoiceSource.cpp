@@ -0,0 +1,36 @@
+#include "VoiceSource.h"
+
+VoiceSource::VoiceSource()
+    : dropped(0)
+{
+  sample.data = NULL;
+  sample.length = 0;
+  sample.blocks = NULL;
+  sample.blockAlign = 0;
+}
+
+void VoiceSource::setSample(const Sample &s)
+{
+  voices.stopAll();
+  sample = s;
+}
+
+bool VoiceSource::trigger(int semitones, uint16_t gain)
+{
+  Trigger t = {(int8_t)semitones, gain};
+  if (triggers.push(t))
+    return true;
+  dropped++;
+  return false;
+}
+
+void VoiceSource::render(int16_t *block, size_t frames)
+{
+  Trigger t;
+  while (triggers.pop(t))
+  {
+    if (sample.data != NULL || sample.blocks != NULL)
+      voices.trigger(sample, t.gain, VoiceMixer::pitchIncrement(t.semitones));
+  }
+  voices.mix(block, frames);
+}
@@ -0,0 +1,45 @@
+#ifndef VOICE_SOURCE_H
+#define VOICE_SOURCE_H
+
+#include <stdint.h>
+#include <AudioPipeline.h>
+#include <SpscQueue.h>
+#include "VoiceMixer.h"
+
+#define VOICE_TRIGGER_QUEUE 16
+
+// Pipeline source that plays one sample in RAM (PCM or IMA ADPCM) on the
+// VoiceMixer's voices. trigger() may be called from one other task (the
+// sequencer task); triggers are picked up at the next block, so they land
+// within one block size.
+class VoiceSource : public AudioBlockSource
+{
+public:
+  VoiceSource();
+
+  // Audio task, or before the pipeline runs. Silence until a sample is set.
+  void setSample(const Sample &sample);
+  // semitones relative to the sample's own pitch, gain in Q15
+  bool trigger(int semitones, uint16_t gain);
+  // Audio task. Voices already playing switch at the next block.
+  void setInterpolation(VoiceMixer::Interpolation mode) { voices.setInterpolation(mode); }
+
+  void render(int16_t *block, size_t frames) override;
+
+  const VoiceMixer &mixer() const { return voices; }
+  uint32_t droppedTriggers() const { return dropped; }
+
+private:
+  struct Trigger
+  {
+    int8_t semitones;
+    uint16_t gain;
+  };
+
+  VoiceMixer voices;
+  Sample sample;
+  SpscQueue<Trigger, VOICE_TRIGGER_QUEUE> triggers; // sequencer -> audio task
+  volatile uint32_t dropped;
+};
+
+#endif
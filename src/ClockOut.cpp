@@ -0,0 +1,129 @@
+#include "ClockOut.h"
+#include "esp_timer.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+ClockOut::ClockOut()
+    : pin(-1), started(false), mux(portMUX_INITIALIZER_UNLOCKED)
+{
+  schedule.setRate(CLOCK_OUT_DEFAULT_PPQN);
+  schedule.setWidth(CLOCK_OUT_WIDTH_US);
+}
+
+bool ClockOut::begin(int outputPin)
+{
+  pin = outputPin;
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+
+  // 1 MHz from the 80 MHz APB clock, the clock esp_timer counts as well
+  timer_config_t config = {};
+  config.divider = 80;
+  config.counter_dir = TIMER_COUNT_UP;
+  config.counter_en = TIMER_PAUSE;
+  config.alarm_en = TIMER_ALARM_EN;
+  config.intr_type = TIMER_INTR_LEVEL;
+  config.auto_reload = TIMER_AUTORELOAD_DIS;
+  if (timer_init(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER, &config) != ESP_OK)
+    return false;
+  timer_set_alarm_value(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER, INT64_MAX);
+  timer_enable_intr(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER);
+  // no ESP_INTR_FLAG_IRAM: PulseSchedule runs from flash, so the interrupt waits out flash writes
+  if (timer_isr_callback_add(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER, &ClockOut::onAlarm, this, 0) != ESP_OK)
+    return false;
+  // the deadlines are esp_timer times: start counting from there, same clock so no drift
+  timer_set_counter_value(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER, (uint64_t)esp_timer_get_time());
+  timer_start(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER);
+  started = true;
+  return true;
+}
+
+void ClockOut::onStep(int64_t deadline, int64_t nextDeadline, uint64_t stepPeriod, uint8_t stepsPerBeat,
+                      bool running)
+{
+  if (!started)
+    return;
+  portENTER_CRITICAL(&mux);
+  if (running)
+  {
+    // the pulse on this step start rose from the alarm already
+    schedule.onStep(deadline, stepPeriod, stepsPerBeat);
+    schedule.expect(nextDeadline, stepPeriod, stepsPerBeat);
+  }
+  else
+  {
+    schedule.stop();
+  }
+  update();
+  portEXIT_CRITICAL(&mux);
+}
+
+void ClockOut::setRunning(bool running, int64_t nextDeadline, uint64_t stepPeriod, uint8_t stepsPerBeat)
+{
+  if (!started)
+    return;
+  portENTER_CRITICAL(&mux);
+  // once running the step callbacks keep the next step armed
+  if (!running)
+    schedule.stop();
+  else if (!schedule.running())
+    schedule.expect(nextDeadline, stepPeriod, stepsPerBeat);
+  update();
+  portEXIT_CRITICAL(&mux);
+}
+
+void ClockOut::moveNextStep(int64_t nextDeadline)
+{
+  if (!started)
+    return;
+  portENTER_CRITICAL(&mux);
+  schedule.moveExpected(nextDeadline);
+  update();
+  portEXIT_CRITICAL(&mux);
+}
+
+bool IRAM_ATTR ClockOut::onAlarm(void *arg)
+{
+  ClockOut *out = static_cast<ClockOut *>(arg);
+  portENTER_CRITICAL_ISR(&out->mux);
+  out->update();
+  portEXIT_CRITICAL_ISR(&out->mux);
+  // no task woken
+  return false;
+}
+
+void ClockOut::update()
+{
+  for (;;)
+  {
+    int64_t now = (int64_t)timer_group_get_counter_value_in_isr(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER);
+    int64_t riseDeadline = 0;
+    int64_t fallDeadline = 0;
+
+    uint8_t events = schedule.poll(now, riseDeadline, fallDeadline);
+    if (events & PulseSchedule::Fall)
+      write(false);
+    if (events & PulseSchedule::Rise)
+      write(true);
+
+    // an alarm behind the counter would only fire once it wraps, so edges
+    // that close are waited for here; INT64_MAX parks the alarm
+    int64_t next = schedule.nextDeadline();
+    if (next > now + CLOCK_OUT_MIN_LEAD_US)
+    {
+      timer_group_set_alarm_value_in_isr(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER, (uint64_t)next);
+      timer_group_enable_alarm_in_isr(CLOCK_OUT_TIMER_GROUP, CLOCK_OUT_TIMER);
+      return;
+    }
+  }
+}
+
+// Straight to the output registers: digitalWrite is not safe in an interrupt
+void ClockOut::write(bool high)
+{
+  uint32_t bit = 1UL << (pin & 31);
+  if (pin < 32)
+    REG_WRITE(high ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, bit);
+  else
+    REG_WRITE(high ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, bit);
+}
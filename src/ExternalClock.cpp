@@ -0,0 +1,43 @@
+#include "ExternalClock.h"
+#include "esp_timer.h"
+
+ExternalClock::ExternalClock()
+    : dropped(0), task(NULL), pulseBits(0), resetBits(0)
+{
+}
+
+bool ExternalClock::begin(int clockPin, int resetPin, TaskHandle_t notifyTask, uint32_t pulse, uint32_t reset)
+{
+  if (notifyTask == NULL)
+    return false;
+  task = notifyTask;
+  pulseBits = pulse;
+  resetBits = reset;
+
+  // GPIO 34-39 have no internal pull resistors, the input stage provides them
+  pinMode(clockPin, INPUT);
+  pinMode(resetPin, INPUT);
+  attachInterruptArg(digitalPinToInterrupt(clockPin), &ExternalClock::onClock, this, RISING);
+  attachInterruptArg(digitalPinToInterrupt(resetPin), &ExternalClock::onReset, this, RISING);
+  return true;
+}
+
+void IRAM_ATTR ExternalClock::onClock(void *arg)
+{
+  ExternalClock *clock = static_cast<ExternalClock *>(arg);
+  BaseType_t woken = pdFALSE;
+  if (!clock->pulses.push(esp_timer_get_time()))
+    clock->dropped++;
+  xTaskNotifyFromISR(clock->task, clock->pulseBits, eSetBits, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+void IRAM_ATTR ExternalClock::onReset(void *arg)
+{
+  ExternalClock *clock = static_cast<ExternalClock *>(arg);
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(clock->task, clock->resetBits, eSetBits, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
@@ -0,0 +1,43 @@
+#include "FrequencyMeter.h"
+
+FrequencyMeter::FrequencyMeter()
+    : estimator(FREQ_CAPTURE_CLOCK, FREQ_WINDOW_TICKS, FREQ_MAX_CYCLES), lastUpdates(0), lastUpdateMs(0)
+{
+}
+
+bool FrequencyMeter::begin(int pin)
+{
+  if (mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_0, pin) != ESP_OK)
+    return false;
+
+  mcpwm_capture_config_t config = {};
+  config.cap_edge = MCPWM_POS_EDGE;
+  config.cap_prescale = 1;
+  config.capture_cb = &FrequencyMeter::onCapture;
+  config.user_data = this;
+  return mcpwm_capture_enable_channel(MCPWM_UNIT_0, MCPWM_SELECT_CAP0, &config) == ESP_OK;
+}
+
+bool IRAM_ATTR FrequencyMeter::onCapture(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel,
+                                         const cap_event_data_t *edata, void *arg)
+{
+  static_cast<FrequencyMeter *>(arg)->estimator.onCapture(edata->cap_value);
+  return false; // no task woken
+}
+
+float FrequencyMeter::read()
+{
+  unsigned long now = millis();
+  uint32_t updates = estimator.updates();
+  if (updates != lastUpdates)
+  {
+    lastUpdates = updates;
+    lastUpdateMs = now;
+  }
+  else if (now - lastUpdateMs > FREQ_TIMEOUT_MS)
+  {
+    estimator.reset();
+    return 0;
+  }
+  return estimator.read();
+}
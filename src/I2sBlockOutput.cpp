@@ -0,0 +1,71 @@
+#include "I2sBlockOutput.h"
+
+I2sBlockOutput::I2sBlockOutput(int bclkPin, int wclkPin, int doutPin, i2s_port_t i2sPort)
+    : port(i2sPort), bclk(bclkPin), wclk(wclkPin), dout(doutPin), installed(false),
+      buffers(I2S_DMA_DEFAULT_BUFFERS), frames(I2S_DMA_DEFAULT_FRAMES)
+{
+}
+
+bool I2sBlockOutput::begin(uint32_t sampleRate, uint8_t dmaBuffers, uint16_t dmaFrames)
+{
+  if (dmaBuffers < I2S_DMA_BUFFERS_MIN || dmaBuffers > I2S_DMA_BUFFERS_MAX || dmaFrames < I2S_DMA_FRAMES_MIN ||
+      dmaFrames > I2S_DMA_FRAMES_MAX)
+    return false;
+  // the DMA descriptors are only set up on install
+  end();
+
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX);
+  config.sample_rate = sampleRate;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.intr_alloc_flags = 0;
+  config.dma_buf_count = dmaBuffers;
+  config.dma_buf_len = dmaFrames;
+  config.use_apll = false;
+  config.tx_desc_auto_clear = true;
+  if (i2s_driver_install(port, &config, 0, NULL) != ESP_OK)
+    return false;
+
+  i2s_pin_config_t pins = {};
+  pins.bck_io_num = bclk;
+  pins.ws_io_num = wclk;
+  pins.data_out_num = dout;
+  pins.data_in_num = I2S_PIN_NO_CHANGE;
+  if (i2s_set_pin(port, &pins) != ESP_OK)
+  {
+    i2s_driver_uninstall(port);
+    return false;
+  }
+  i2s_zero_dma_buffer(port);
+  buffers = dmaBuffers;
+  frames = dmaFrames;
+  installed = true;
+  return true;
+}
+
+void I2sBlockOutput::end()
+{
+  if (!installed)
+    return;
+  i2s_driver_uninstall(port);
+  installed = false;
+}
+
+size_t I2sBlockOutput::write(const int16_t *block, size_t count)
+{
+  if (!installed)
+    return 0;
+  if (count > AUDIO_BLOCK_MAX)
+    count = AUDIO_BLOCK_MAX;
+  for (size_t i = 0; i < count; i++)
+  {
+    stereo[2 * i] = block[i];
+    stereo[2 * i + 1] = block[i];
+  }
+  // blocks until the DMA frees enough buffers, which paces the audio task
+  size_t bytes = 0;
+  i2s_write(port, stereo, count * 2 * sizeof(int16_t), &bytes, pdMS_TO_TICKS(I2S_WRITE_TIMEOUT_MS));
+  return bytes / (2 * sizeof(int16_t));
+}
@@ -0,0 +1,184 @@
+#include "SampleLoader.h"
+#include "AudioGeneratorWAV.h"
+#include "AudioOutput.h"
+#include <WavHeader.h>
+
+// AudioOutput that keeps what a generator produces instead of playing it
+class CaptureOutput : public AudioOutput
+{
+public:
+  CaptureOutput(int16_t *buffer, uint32_t capacity)
+      : data(buffer), size(capacity), length(0), rate(0)
+  {
+  }
+
+  bool SetRate(int hz) override
+  {
+    rate = hz;
+    return true;
+  }
+  bool begin() override { return true; }
+  bool stop() override { return true; }
+
+  // false tells the generator the output is full, so its loop() returns
+  bool ConsumeSample(int16_t sample[2]) override
+  {
+    if (length == size)
+      return false;
+    // generators always fill both channels, mono ones with the same value
+    data[length++] = ((int32_t)sample[0] + sample[1]) >> 1;
+    return true;
+  }
+
+  bool full() const { return length == size; }
+
+  int16_t *data;
+  uint32_t size;
+  uint32_t length;
+  int rate;
+};
+
+// a cut off sample would end on a click
+static void fadeOut(int16_t *samples, uint32_t length)
+{
+  uint32_t fade = length < SAMPLE_FADE ? length : SAMPLE_FADE;
+  for (uint32_t i = 0; i < fade; i++)
+  {
+    int16_t &s = samples[length - fade + i];
+    s = (int32_t)s * (int32_t)(fade - i) / (int32_t)fade;
+  }
+}
+
+// Reads length bytes into a new buffer, NULL if the file ends early
+static uint8_t *readData(AudioFileSource *source, uint32_t offset, uint32_t length)
+{
+  if (!source->seek(offset, SEEK_SET))
+    return NULL;
+  uint8_t *buffer = (uint8_t *)malloc(length);
+  if (buffer == NULL)
+    return NULL;
+  uint32_t got = 0;
+  while (got < length)
+  {
+    uint32_t n = source->read(buffer + got, length - got);
+    if (n == 0)
+    {
+      free(buffer);
+      return NULL;
+    }
+    got += n;
+  }
+  return buffer;
+}
+
+static bool loadAdpcm(AudioFileSource *source, const WavFormat &wav, uint32_t maxBytes, Sample &sample)
+{
+  // whole blocks only, a block needs its header to decode
+  uint32_t bytes = wav.dataSize <= maxBytes ? wav.dataSize : maxBytes / wav.blockAlign * wav.blockAlign;
+  uint32_t length = imaSampleCount(bytes, wav.blockAlign);
+  if (length == 0)
+    return false;
+  uint8_t *blocks = readData(source, wav.dataOffset, bytes);
+  if (blocks == NULL)
+    return false;
+
+  if (bytes < wav.dataSize)
+  {
+    // decode the last block, fade it and encode it again from its own step index
+    uint8_t *last = blocks + bytes - wav.blockAlign;
+    int16_t *samples = (int16_t *)malloc(imaSamplesPerBlock(wav.blockAlign) * sizeof(int16_t));
+    if (samples != NULL)
+    {
+      size_t count = imaDecodeBlock(last, wav.blockAlign, samples);
+      fadeOut(samples, count);
+      ImaState state = {0, last[2]};
+      imaEncodeBlock(samples, count, state, last, wav.blockAlign);
+      free(samples);
+    }
+  }
+
+  sample.data = NULL;
+  sample.length = length;
+  sample.blocks = blocks;
+  sample.blockAlign = wav.blockAlign;
+  return true;
+}
+
+static bool loadPcm(AudioFileSource *source, const WavFormat &wav, uint32_t maxBytes, Sample &sample)
+{
+  uint32_t bytes = (wav.dataSize <= maxBytes ? wav.dataSize : maxBytes) & ~1u;
+  if (bytes == 0)
+    return false;
+  // WAV samples are little endian like the ESP32
+  int16_t *data = (int16_t *)readData(source, wav.dataOffset, bytes);
+  if (data == NULL)
+    return false;
+  if (bytes < wav.dataSize)
+    fadeOut(data, bytes / 2);
+
+  sample.data = data;
+  sample.length = bytes / 2;
+  sample.blocks = NULL;
+  sample.blockAlign = 0;
+  return true;
+}
+
+static bool loadThroughGenerator(AudioFileSource *source, uint32_t maxBytes, Sample &sample, uint32_t &sampleRate)
+{
+  uint32_t capacity = maxBytes / sizeof(int16_t);
+  int16_t *buffer = capacity > 0 ? (int16_t *)malloc(capacity * sizeof(int16_t)) : NULL;
+  if (buffer == NULL)
+    return false;
+
+  source->seek(0, SEEK_SET);
+  CaptureOutput capture(buffer, capacity);
+  AudioGeneratorWAV *generator = new AudioGeneratorWAV();
+  if (generator->begin(source, &capture))
+  {
+    while (generator->isRunning() && !capture.full())
+    {
+      if (!generator->loop())
+        break;
+    }
+    generator->stop();
+  }
+  delete generator;
+
+  if (capture.length == 0)
+  {
+    free(buffer);
+    return false;
+  }
+  if (capture.full())
+    fadeOut(buffer, capture.length);
+
+  sample.data = buffer;
+  sample.length = capture.length;
+  sample.blocks = NULL;
+  sample.blockAlign = 0;
+  sampleRate = capture.rate;
+  return true;
+}
+
+bool loadSample(AudioFileSource *source, uint32_t maxBytes, Sample &sample, uint32_t &sampleRate,
+                uint32_t &fileSamples)
+{
+  uint8_t header[WAV_HEADER_MAX];
+  WavFormat wav;
+  uint32_t length = source->read(header, sizeof(header));
+  if (!parseWavHeader(header, length, wav))
+    return false;
+
+  sampleRate = wav.sampleRate;
+  if (wav.format == WAV_FORMAT_IMA_ADPCM)
+  {
+    if (wav.channels != 1 || wav.blockAlign <= IMA_BLOCK_HEADER)
+      return false;
+    fileSamples = imaSampleCount(wav.dataSize, wav.blockAlign);
+    return loadAdpcm(source, wav, maxBytes, sample);
+  }
+  fileSamples = wav.blockAlign > 0 ? wav.dataSize / wav.blockAlign : 0;
+  if (wav.format == WAV_FORMAT_PCM && wav.channels == 1 && wav.bitsPerSample == 16)
+    return loadPcm(source, wav, maxBytes, sample);
+  return loadThroughGenerator(source, maxBytes, sample, sampleRate);
+}
@@ -0,0 +1,93 @@
+#include "StepClock.h"
+
+StepClock::StepClock()
+    : timer(NULL), mux(portMUX_INITIALIZER_UNLOCKED), onStep(NULL), onGateOff(NULL)
+{
+}
+
+bool StepClock::begin(StepCallback stepCb, GateCallback gateCb)
+{
+  onStep = stepCb;
+  onGateOff = gateCb;
+
+  esp_timer_create_args_t args = {};
+  args.callback = &StepClock::timerCallback;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "step";
+  if (esp_timer_create(&args, &timer) != ESP_OK)
+    return false;
+
+  int64_t now = esp_timer_get_time();
+  schedule.start(now);
+  arm(now);
+  return true;
+}
+
+void StepClock::setPeriod(uint64_t period, uint32_t gate)
+{
+  portENTER_CRITICAL(&mux);
+  schedule.setPeriod(period, gate);
+  portEXIT_CRITICAL(&mux);
+}
+
+void StepClock::align(int64_t anchor, uint64_t period, uint32_t gate)
+{
+  portENTER_CRITICAL(&mux);
+  schedule.setPeriod(period, gate);
+  schedule.align(anchor);
+  portEXIT_CRITICAL(&mux);
+  // the timer may still be armed for the old grid. If fire() re-arms in between,
+  // start_once fails and the worst case is one wake-up with nothing due.
+  esp_timer_stop(timer);
+  arm(esp_timer_get_time());
+}
+
+uint64_t StepClock::getPeriod()
+{
+  portENTER_CRITICAL(&mux);
+  uint64_t period = schedule.period();
+  portEXIT_CRITICAL(&mux);
+  return period;
+}
+
+int64_t StepClock::getNextStep()
+{
+  portENTER_CRITICAL(&mux);
+  int64_t next = schedule.nextStepDeadline();
+  portEXIT_CRITICAL(&mux);
+  return next;
+}
+
+void StepClock::timerCallback(void *arg)
+{
+  static_cast<StepClock *>(arg)->fire();
+}
+
+void StepClock::fire()
+{
+  int64_t now = esp_timer_get_time();
+  int64_t stepDeadline = 0;
+  int64_t gateDeadline = 0;
+
+  portENTER_CRITICAL(&mux);
+  uint8_t events = schedule.poll(now, stepDeadline, gateDeadline);
+  portEXIT_CRITICAL(&mux);
+
+  if ((events & StepSchedule::GateOff) && onGateOff)
+    onGateOff(gateDeadline, now);
+  if ((events & StepSchedule::Step) && onStep)
+    onStep(stepDeadline, now);
+
+  arm(esp_timer_get_time());
+}
+
+void StepClock::arm(int64_t now)
+{
+  portENTER_CRITICAL(&mux);
+  int64_t wait = schedule.nextDeadline() - now;
+  portEXIT_CRITICAL(&mux);
+  if (wait < 1)
+    wait = 1;
+  esp_timer_start_once(timer, (uint64_t)wait);
+}
@@ -0,0 +1,192 @@
+#include "StreamingSource.h"
+
+StreamingSource::StreamingSource(fs::FS &filesystem)
+    : fs(filesystem), task(NULL), waiting(NULL), pending(None), requestArg(0), requestOk(false), opened(false),
+      eof(false), size(0), position(0), underrunCount(0)
+{
+  path[0] = 0;
+}
+
+bool StreamingSource::begin()
+{
+  if (task != NULL)
+    return true;
+  return xTaskCreatePinnedToCore(taskEntry, "prefetch", STREAM_STACK, this, STREAM_PRIORITY, &task, STREAM_CORE) ==
+         pdPASS;
+}
+
+void StreamingSource::taskEntry(void *arg)
+{
+  static_cast<StreamingSource *>(arg)->run();
+}
+
+void StreamingSource::run()
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_POLL_MS));
+    // the owner may free this object as soon as Quit is answered
+    if (serve())
+      break;
+    fill();
+  }
+  vTaskDelete(NULL);
+}
+
+void StreamingSource::end()
+{
+  if (task == NULL)
+    return;
+  // a slow read in fill() may hold the task up, but it must be gone before the owner frees this
+  request(Quit, 0, STREAM_WAIT_FOREVER);
+  task = NULL;
+}
+
+bool StreamingSource::request(Request what, uint32_t arg, uint32_t timeoutMs)
+{
+  if (task == NULL)
+    return false;
+  waiting = xTaskGetCurrentTaskHandle();
+  uint32_t started = millis();
+  // a request that timed out earlier may still be in the works
+  while (pending != None && (timeoutMs == STREAM_WAIT_FOREVER || millis() - started < timeoutMs))
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_POLL_MS));
+  if (pending != None)
+    return false;
+  requestArg = arg;
+  requestOk = false;
+  pending = what;
+  xTaskNotifyGive(task);
+  // the prefetch task clears pending last, after everything else is in place
+  while (pending != None && (timeoutMs == STREAM_WAIT_FOREVER || millis() - started < timeoutMs))
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_POLL_MS));
+  return pending == None && requestOk;
+}
+
+// The caller waits in request() meanwhile, so the ring can be cleared from here
+bool StreamingSource::serve()
+{
+  Request what = pending;
+  if (what == None)
+    return false;
+
+  bool ok = false;
+  switch (what)
+  {
+  case Open:
+    if (file)
+      file.close();
+    file = fs.open(path, "r");
+    ok = file && !file.isDirectory();
+    size = ok ? file.size() : 0;
+    opened = ok;
+    break;
+
+  case Seek:
+    ok = opened && file.seek(requestArg);
+    break;
+
+  case Close:
+  case Quit:
+    if (file)
+      file.close();
+    opened = false;
+    ok = true;
+    break;
+
+  default:
+    break;
+  }
+  ring.clear();
+  eof = false;
+  requestOk = ok;
+  pending = None;
+  xTaskNotifyGive(waiting);
+  return what == Quit;
+}
+
+void StreamingSource::fill()
+{
+  while (opened && !eof && pending == None && ring.space() >= STREAM_CHUNK)
+  {
+    size_t n = file.read(chunk, STREAM_CHUNK);
+    if (n == 0)
+    {
+      eof = true;
+      break;
+    }
+    ring.write(chunk, n);
+  }
+}
+
+bool StreamingSource::open(const char *filename)
+{
+  strncpy(path, filename, STREAM_PATH_MAX - 1);
+  path[STREAM_PATH_MAX - 1] = 0;
+  position = 0;
+  return request(Open, 0);
+}
+
+uint32_t StreamingSource::read(void *data, uint32_t length)
+{
+  if (!opened)
+    return 0;
+  uint8_t *out = static_cast<uint8_t *>(data);
+  uint32_t done = 0;
+  bool stalled = false;
+  uint32_t started = 0;
+  while (done < length)
+  {
+    size_t n = ring.read(out + done, length - done);
+    done += n;
+    if (n > 0)
+      continue;
+    // eof is set after the last write, so an empty ring seen after it is the real end
+    if (eof && ring.available() == 0)
+      break;
+    if (!stalled)
+    {
+      stalled = true;
+      underrunCount++;
+      started = millis();
+    }
+    else if (millis() - started > STREAM_STALL_MS)
+    {
+      break;
+    }
+    xTaskNotifyGive(task);
+    vTaskDelay(1);
+  }
+  position += done;
+  if (ring.space() >= STREAM_CHUNK)
+    xTaskNotifyGive(task);
+  return done;
+}
+
+bool StreamingSource::seek(int32_t pos, int dir)
+{
+  int64_t target = pos;
+  if (dir == SEEK_CUR)
+    target += position;
+  else if (dir == SEEK_END)
+    target += size;
+  if (target < 0 || target > size)
+    return false;
+
+  // forward within what is already buffered, e.g. skipping a WAV chunk
+  if (target >= position && target - position <= (int64_t)ring.available())
+  {
+    ring.skip(target - position);
+    position = target;
+    return true;
+  }
+  if (!request(Seek, target))
+    return false;
+  position = target;
+  return true;
+}
+
+bool StreamingSource::close()
+{
+  return request(Close, 0);
+}
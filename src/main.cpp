@@ -29,36 +29,117 @@
 #include <Adafruit_MCP4728.h>
 #include <Wire.h>
 #include <Defs.h>
-#include "AudioFileSourcePROGMEM.h"
-#include "AudioGeneratorWAV.h"
-#include "AudioOutputI2SNoDAC.h"
+#include <StepClock.h>
+#include <Protocol.h>
+#include <Sequencer.h>
+#include <NotifyScheduler.h>
+#include <ConnectionFsm.h>
+#include <FrequencyMeter.h>
+#include <ExternalClock.h>
+#include <ClockFollower.h>
+#include <ClockOut.h>
+#include <BleMidi.h>
+#include <TimedQueue.h>
+#include <LatencyHistogram.h>
+#include <NoteTable.h>
+#include <VcoCalibration.h>
+#include <Preferences.h>
+#include <BleCapture.h>
+#include <StreamingSource.h>
+#include <SampleLoader.h>
+#include <AudioPipeline.h>
+#include <VoiceSource.h>
+#include <I2sBlockOutput.h>
 #include "vfs_api.h"
 #include "WiFi.h"
+#include "SPIFFS.h"
 #include "SD.h"
 
+// Samples are streamed from a filesystem instead of being compiled in, so they
+// can be swapped without reflashing. data/ goes to the SPIFFS partition with
+// pio run -t uploadfs, or copy the files to the root of an SD card.
 // VIOLA sample taken from https://ccrma.stanford.edu/~jos/pasp/Sound_Examples.html
-#include "viola.h"
+#define SAMPLE_ON_SD 0 // 1: read SAMPLE_PATH from the SD card on SD_CS_PIN, 0: from SPIFFS
+#define SAMPLE_PATH "/viola-ima.wav" // mono IMA ADPCM (native_adpcm converts) or 16-bit PCM like /viola.wav
+#define SAMPLE_RAM_BYTES 65536 // longer files are cut: 2.9 s of IMA ADPCM or 0.74 s of PCM at 44.1 kHz
+#define SAMPLE_ROOT_NOTE 36      // step note that plays the sample at its own pitch
+#define VOICE_STEP_GAIN 16384    // Q15, two voices at full scale before the mix clips
 
-AudioGeneratorWAV *wav;
-AudioFileSourcePROGMEM *file;
-AudioOutputI2S *out;
+// Block pipeline on the audio task: voices -> DC blocker -> I2S DMA. Block
+// size and DMA buffers are OP_Audio settings, kept in preferences.
+#define AUDIO_DEFAULT_BLOCK 64
+#define AUDIO_QUEUE_SIZE 4
+#define AUDIO_DEFAULT_INTERPOLATION VoiceMixer::Hermite
+#define AUDIO_REPORT_LENGTH 15
 
-#define SQUARE_GATE_PIN 2     // HIGH-LOW
-#define SUB_SEQ_PIN 4         // HIGH-LOW
-#define ANALOG_DIGITAL_PIN 13 // HIGH-LOW
-#define GATE_PIN 27
-#define FREQUENCY_PIN 19
+struct AudioSettings
+{
+  uint8_t blockSize; // frames
+  uint8_t dmaBuffers;
+  uint16_t dmaFrames; // per buffer
+  uint8_t interpolation; // VoiceMixer::Interpolation
+};
+
+Sample sample;
+uint32_t sampleRate = 44100;
+VoiceSource voices;
+DcBlocker dcBlocker;
+I2sBlockOutput i2sOut(33, 25, 32);
+AudioPipeline pipeline(esp_timer_get_time);
+AudioSettings audioSettings = {AUDIO_DEFAULT_BLOCK, I2S_DMA_DEFAULT_BUFFERS, I2S_DMA_DEFAULT_FRAMES,
+                               AUDIO_DEFAULT_INTERPOLATION}; // audio task
+SpscQueue<Command, AUDIO_QUEUE_SIZE> audioCommands; // sequencer -> audio task
+
+// Tasks: sequencer and audio share core 1 (sequencer preempts audio), BLE and
+// housekeeping live on core 0 next to the Bluetooth controller.
+// loop() keeps the lowest priority on core 1 and only refreshes the frequency reading.
+#define SEQUENCER_CORE 1
+#define SEQUENCER_PRIORITY 5
+#define AUDIO_CORE 1
+#define AUDIO_PRIORITY 3
+#define BLE_CORE 0
+#define BLE_PRIORITY 2
+
+#define EVT_STEP (1 << 0)
+#define EVT_GATE_OFF (1 << 1)
+#define EVT_COMMAND (1 << 2)
+#define EVT_CLOCK (1 << 3)
+#define EVT_RESET (1 << 4)
+#define EVT_MIDI (1 << 5)
+#define EVT_TIMER (1 << 6)
+
+#define TX_QUEUE_LENGTH 16
+#define TX_MAX_LENGTH 16
+#define NOTIFY_MIN_PERIOD_US 7500 // never notify faster than the shortest BLE connection interval
+#define NOTIFY_POLL_MS 2
+#define NOTIFY_STATS_MS 10000 // notifier counters on Serial, when they changed
+
+// 1: print every inbound write on Serial in the BleCapture format, for the native replayer
+#define BLE_CAPTURE 0
+#define CAPTURE_QUEUE_SIZE 32
+
+struct TxMessage
+{
+  uint8_t length;
+  uint8_t data[TX_MAX_LENGTH];
+};
+
+TaskHandle_t sequencerTaskHandle = NULL;
+TaskHandle_t audioTaskHandle = NULL;
+TaskHandle_t bleTaskHandle = NULL;
+QueueHandle_t txQueue = NULL;
 
 BLEServer *pServer = NULL;
 BLECharacteristic *pTxCharacteristic;
+BLE2902 *pTxCccd;
 bool deviceConnected = false;
-bool oldDeviceConnected = false;
+ConnectionFsm connection;
 uint8_t txValue[3] = {};
 bool led_on = false;
-bool latencyMode = true;
-unsigned long startTime = 0;
-unsigned long currentTime = 0;
-uint32_t latency = 0;
+bool latencyMode = true;       // OP_Ping answered and measured, sequencer task
+unsigned long startTime = 0;   // arrival of the last ping, BLE task
+unsigned long currentTime = 0; // when it was answered
+uint32_t latency = 0;          // the difference, us
 
 Adafruit_MCP4728 mcp;
 
@@ -77,49 +158,110 @@ int voltage = 100;
 #define CHARACTERISTIC_UUID_RX "6E400002-B5A3-F393-E0A9-E50E24DCCA9E"
 #define CHARACTERISTIC_UUID_TX "6E400003-B5A3-F393-E0A9-E50E24DCCA9E"
 
-// Variables used to calculate tempo
-// set BPM
-int bpm = 120;
-int *pBpm = &bpm;
-// set Subdivision 1=quarter note; 0.5 ->eight note, ....
-float subdivision = 1;
-int interval;
-int *pInterval = &interval;
-unsigned long tInterval;
-unsigned long tGate;
-int gatePercentage = 1; //percentage of interval
-int gateInterval;
-unsigned long tFreq = 1;
+// BLE-MIDI, so DAWs and stock MIDI apps can play and clock the sequencer
+#define MIDI_SERVICE_UUID "03B80E5A-EDE8-4B33-A751-6CE34EC4C700"
+#define MIDI_CHARACTERISTIC_UUID "7772E5DB-3868-4112-A1A9-F2669D106BF3"
+
+// Connection tuning. Intervals in 1.25 ms units, supervision timeout in 10 ms units.
+// While playing we ask for the shortest interval and no slave latency, while idle
+// a longer interval with latency lets the radio sleep.
+#define PLAY_MIN_INTERVAL 6 // 7.5 ms
+#define PLAY_MAX_INTERVAL 12
+#define PLAY_LATENCY 0
+#define PLAY_TIMEOUT 200
+#define IDLE_MIN_INTERVAL 40 // 50 ms
+#define IDLE_MAX_INTERVAL 80
+#define IDLE_LATENCY 4
+#define IDLE_TIMEOUT 600
+
+esp_bd_addr_t peerAddress;
+volatile uint16_t connId = 0;
+volatile uint16_t negotiatedMtu = 23;
+volatile uint16_t connInterval = 0;
+volatile uint16_t connLatency = 0;
+volatile bool statusChanged = false;
+bool lowLatencyParams = false;
+NotifyScheduler notifier(NOTIFY_MIN_PERIOD_US);
+unsigned long lastNotifyStats = 0;
+uint32_t reportedNotifies = 0; // packets + replaced + overflowed at the last report
+
+// Tempo the step clock was last set up for, the period is only recomputed when these change
+uint32_t clockTempo = 0; // 1/100 BPM
+uint8_t clockSubdivision = 0;
+int clockGatePercentage = 0;
+bool clockFollowing = false;
+
+// External clock: pulses per quarter note on CLOCK_IN_PIN. 4 = one pulse per sixteenth,
+// steps between pulses are interpolated from the followed period.
+#define EXT_CLOCK_PPQN 4
+#define CLOCK_STATUS_MS 250
+ExternalClock externalClock;
+ClockFollower clockFollower(EXT_CLOCK_PPQN);
+volatile uint8_t clockSource = ClockInternal;
+unsigned long lastClockStatus = 0;
+ClockOut clockOut;
+
+// OP_Sync and OP_Ping replies: stamped on arrival by Sequencer::receive() and
+// answered by the BLE task, outside the notifier so they are never held back.
+// OP_Latency requests take the same way since the histogram belongs to the BLE task.
+#define PING_QUEUE_SIZE 8
+#define SYNC_REPLY_LENGTH 10
+#define PING_REPLY_LENGTH 6
+#define LATENCY_REPORT_LENGTH (6 + LATENCY_BUCKETS)
+
+struct Ping
+{
+  uint8_t op;
+  uint8_t sequence; // data 1 for OP_Latency
+  uint32_t arrival;
+};
+
+SpscQueue<Ping, PING_QUEUE_SIZE> pingQueue; // sequencer -> bleTask
+LatencyHistogram pingLatency;               // BLE task
+
+// BLE-MIDI events run at the sender's timestamp plus a fixed latency that
+// covers the delivery jitter of one connection interval, instead of on arrival
+#define MIDI_LATENCY_US 20000
+#define MIDI_LATE_US 1000 // executed this much after its time counts as late
+#define MIDI_QUEUE_SIZE 64
+#define MIDI_PACKET_EVENTS 32
+#define MIDI_NOTE_BASE 24 // MIDI C1 plays note 0 of the note table
+#define MIDI_CLOCK_PPQN 24
+
+struct TimedMidi
+{
+  int64_t at;
+  MidiEvent event;
+};
+
+BleMidiParser midiParser;  // BLE host task
+MidiTimeline midiTimeline; // BLE host task
+SpscQueue<TimedMidi, MIDI_QUEUE_SIZE> midiQueue;    // BLE host task -> sequencer
+TimedQueue<MidiEvent, MIDI_QUEUE_SIZE> midiPending; // sequencer task
+esp_timer_handle_t eventTimer = NULL; // wakes the sequencer task for MIDI events and timed commands
+ClockFollower midiFollower(MIDI_CLOCK_PPQN);
+volatile uint32_t midiDropped = 0;
+volatile uint32_t midiLate = 0;
+StepClock stepClock;
+FrequencyMeter frequencyMeter;
 float frequency;
-float T;
-float trustFactor = 0.7;
-float prevFrequency;
-uint8_t stepIndex = 0;
-// play/stop
-bool play = false;
-bool gate = false;
-
-// frequency detection
-bool squarePositive = false;
-bool squareAux = false;
-
-int sequence[] = {
-    0,
-    0,
-    1000,
-    1000,
-    2000,
-    2000,
-    3000,
-    3000,
-    4000,
-    4000,
-    5000,
-    5000,
-    6000,
-    6000,
-    7000,
-    7000};
+Sequencer sequencer(mcp);
+
+// VCO calibration: sweep the DAC, measure the VCO and map every note to a DAC code
+#define CALIBRATION_STEP 128      // DAC codes between sweep points
+#define CALIBRATION_SETTLE_MS 30  // VCO slew after a DAC change
+#define CALIBRATION_MEASURE_MS 1000
+#define CALIBRATION_MIN_NOTES 12
+#define CALIBRATION_CORE 0
+#define CALIBRATION_PRIORITY 1
+
+#if BLE_CAPTURE
+SpscQueue<CaptureRecord, CAPTURE_QUEUE_SIZE> captureQueue; // BLE host task -> bleTask
+#endif
+
+NoteTable noteTables[2];
+volatile bool calibrating = false;
+Preferences preferences;
 
 class MyServerCallbacks : public BLEServerCallbacks
 {
@@ -128,6 +270,20 @@ class MyServerCallbacks : public BLEServerCallbacks
     deviceConnected = true;
   };
 
+  void onConnect(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
+  {
+    memcpy(peerAddress, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+    connId = param->connect.conn_id;
+    negotiatedMtu = 23;
+    lowLatencyParams = !sequencer.playing(); // force a parameter request from bleTask
+  }
+
+  void onMtuChanged(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
+  {
+    negotiatedMtu = param->mtu.mtu;
+    statusChanged = true;
+  }
+
   void onDisconnect(BLEServer *pServer)
   {
     deviceConnected = false;
@@ -136,114 +292,724 @@ class MyServerCallbacks : public BLEServerCallbacks
 
 class MyCallbacks : public BLECharacteristicCallbacks
 {
+  // Runs on the BLE host task: decode and hand over, the sequencer applies it at the next step
+  void onWrite(BLECharacteristic *pCharacteristic)
+  {
+#if BLE_CAPTURE
+    CaptureRecord record;
+    makeRecord(record, micros(), pCharacteristic->getData(), pCharacteristic->getLength());
+    captureQueue.push(record);
+#endif
+    if (sequencer.receive(pCharacteristic->getData(), pCharacteristic->getLength()))
+      xTaskNotify(sequencerTaskHandle, EVT_COMMAND, eSetBits);
+  }
+};
+
+class MidiCallbacks : public BLECharacteristicCallbacks
+{
+  // BLE host task: parse and time the packet, the sequencer task runs the events
   void onWrite(BLECharacteristic *pCharacteristic)
   {
-    uint8_t *rxPrt = pCharacteristic->getData();
-    uint8_t rxValue[MSG_LENGTH];
-    for (size_t i = 0; i < MSG_LENGTH; i++)
+    int64_t now = esp_timer_get_time();
+    MidiEvent events[MIDI_PACKET_EVENTS];
+    int n = midiParser.parse(pCharacteristic->getData(), pCharacteristic->getLength(), events, MIDI_PACKET_EVENTS);
+    if (n <= 0)
+      return;
+    midiTimeline.onPacket(now, events[0].timestamp);
+    for (int i = 0; i < n; i++)
     {
-      rxValue[i] = *rxPrt;
-      rxPrt++;
+      TimedMidi timed = {midiTimeline.toDevice(events[i].timestamp) + MIDI_LATENCY_US, events[i]};
+      if (!midiQueue.push(timed))
+        midiDropped++;
     }
-    switch (rxValue[0])
+    xTaskNotify(sequencerTaskHandle, EVT_MIDI, eSetBits);
+  }
+};
+
+void sendMessage(const uint8_t *data, uint8_t length)
+{
+  TxMessage msg;
+  if (length > TX_MAX_LENGTH)
+    return;
+  msg.length = length;
+  memcpy(msg.data, data, length);
+  // never block the sequencer on BLE, a lost step position is refreshed by the next one
+  xQueueSend(txQueue, &msg, 0);
+}
+
+void putLE32(uint8_t *p, uint32_t value)
+{
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+  p[2] = (value >> 16) & 0xFF;
+  p[3] = value >> 24;
+}
+
+NoteTable *loadNoteTable()
+{
+  NoteTable *table = &noteTables[0];
+  preferences.begin("owl", true);
+  size_t length = preferences.getBytes("notes", table, sizeof(NoteTable));
+  preferences.end();
+  if (length != sizeof(NoteTable) || table->magic != NOTE_TABLE_MAGIC)
+  {
+    buildDefaultTable(*table);
+    Serial.println("Using default note table");
+  }
+  return table;
+}
+
+// Waits for an estimate that only covers edges after the DAC change
+float measureFrequency()
+{
+  uint32_t start = frequencyMeter.updates();
+  unsigned long t0 = millis();
+  while (frequencyMeter.updates() - start < 2)
+  {
+    if (millis() - t0 > CALIBRATION_MEASURE_MS)
+      return 0;
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  return frequencyMeter.read();
+}
+
+void calibrationTask(void *param)
+{
+  static VcoCalibration calibration;
+  calibration.clear();
+  digitalWrite(GATE_PIN, HIGH);
+
+  float lastHz = 0;
+  for (uint32_t code = 0; code <= DAC_TOTAL_CODE; code += CALIBRATION_STEP)
+  {
+    NoteCode split = splitCode(code);
+    mcp.fastWrite(0, 0, split.c, split.d);
+    vTaskDelay(pdMS_TO_TICKS(CALIBRATION_SETTLE_MS));
+    float hz = measureFrequency();
+    // below the VCO range or saturated at the top: not usable for the fit
+    if (hz > lastHz)
     {
-    case OP_Tempo:
-      bpm = rxValue[1] + 1;
-      break;
+      calibration.addPoint(code, hz);
+      lastHz = hz;
+    }
+  }
+  digitalWrite(GATE_PIN, LOW);
 
-    case OP_PlayStop:
-      Serial.println("llego un OP_PlayStop !!!");
-      if (rxValue[1] == Play)
-      {
-        play = true;
-      }
-      else if (rxValue[1] == Pause)
-      {
-        play = false;
-      }
-      else
-      {
-        play = false;
-        stepIndex = 0;
-      }
-      break;
+  NoteTable *spare = (sequencer.noteTable() == &noteTables[0]) ? &noteTables[1] : &noteTables[0];
+  uint8_t reached = calibration.build(*spare);
+  if (reached >= CALIBRATION_MIN_NOTES)
+  {
+    sequencer.setNoteTable(spare);
+    preferences.begin("owl", false);
+    preferences.putBytes("notes", spare, sizeof(NoteTable));
+    preferences.end();
+  }
+  Serial.printf("Calibration: %u points, %u notes\n", calibration.points(), reached);
+
+  uint8_t result[3] = {OP_Calibrate, reached, calibration.points()};
+  sendMessage(result, sizeof(result));
+
+  calibrating = false;
+  sequencer.setMuted(false);
+  vTaskDelete(NULL);
+}
 
-    case OP_Note:
-      sequence[rxValue[1]] = (rxValue[2] * 83);
-      //sequence[rxValue[1]] = 17 + (rxValue[2] * 83); //notes come as multiple of 83mV, 17 offset for 100mV (17+83)minimum for DAC
-      Serial.println("llego un OP Note !!!");
+void startCalibration()
+{
+  if (calibrating)
+    return;
+  calibrating = true;
+  sequencer.setMuted(true);
+  xTaskCreatePinnedToCore(calibrationTask, "calibration", 4096, NULL, CALIBRATION_PRIORITY, NULL, CALIBRATION_CORE);
+}
+
+// Commands the sequencer leaves to the firmware, runs on the sequencer task
+void handleCommand(const Command &cmd)
+{
+  switch (cmd.op)
+  {
+  case OP_Calibrate:
+    startCalibration();
+    break;
+
+  case OP_Clock:
+    clockSource = cmd.arg;
+    clockFollower.reset();
+    midiFollower.reset();
+    break;
+
+  case OP_ClockOut:
+    clockOut.setRate(cmd.arg);
+    break;
+
+  case OP_Audio:
+    audioCommands.push(cmd);
+    break;
+
+  case OP_Latency:
+    if (cmd.arg == LatencyOff || cmd.arg == LatencyOn)
+    {
+      latencyMode = cmd.arg == LatencyOn;
       break;
+    }
+    // fall through, report and reset are up to the BLE task
+  case OP_Sync:
+  case OP_Ping:
+  {
+    if (cmd.op == OP_Ping && !latencyMode)
+      break;
+    Ping ping = {cmd.op, cmd.arg, cmd.at};
+    if (pingQueue.push(ping))
+    {
+      // an empty message wakes the BLE task, the reply must not wait out its poll period
+      TxMessage wake = {};
+      xQueueSend(txQueue, &wake, 0);
+    }
+    break;
+  }
 
-    case OP_Route:
-      Serial.println("llego un OP Route !!!");
-      switch (rxValue[1])
-      {
-      case Square:
-        Serial.println("Square");
-        digitalWrite(SQUARE_GATE_PIN, HIGH);
-        break;
-      case Gate:
-        Serial.println("Gate");
-        digitalWrite(SQUARE_GATE_PIN, LOW);
-        break;
-      case Sub:
-        Serial.println("Sub");
-        digitalWrite(SUB_SEQ_PIN, HIGH);
-        break;
-      case Seq:
-        Serial.println("Seq");
-        digitalWrite(SUB_SEQ_PIN, LOW);
-        break;
-      case A_out:
-        Serial.println("Sine");
-        digitalWrite(ANALOG_DIGITAL_PIN, HIGH);
-        break;
-      case D_out:
-        Serial.println("Digital out");
-        digitalWrite(ANALOG_DIGITAL_PIN, LOW);
-        break;
+  default:
+    break;
+  }
+}
 
-      default:
+// StepClock callbacks run in the esp_timer task; they only wake the sequencer
+// and lay out the clock output pulses of the step
+void onStep(int64_t scheduled, int64_t fired)
+{
+  xTaskNotify(sequencerTaskHandle, EVT_STEP, eSetBits);
+  clockOut.onStep(scheduled, stepClock.getNextStep(), stepClock.getPeriod(), sequencer.subdivision,
+                  sequencer.playing());
+}
+
+void onGateOff(int64_t scheduled, int64_t fired)
+{
+  xTaskNotify(sequencerTaskHandle, EVT_GATE_OFF, eSetBits);
+}
+
+ClockFollower &activeFollower()
+{
+  return clockSource == ClockMidi ? midiFollower : clockFollower;
+}
+
+// Runs on the sequencer task: PLL update per pulse, and once locked every pulse
+// that starts a step pulls the step grid onto the followed clock
+void followPulse(ClockFollower &follower, int64_t at)
+{
+  if (!follower.pulse(at))
+    return;
+  uint8_t subdivision = sequencer.subdivision;
+  if (!follower.onStep(subdivision))
+    return;
+  uint64_t period = follower.stepPeriod(subdivision);
+  stepClock.align(follower.phase(), period, (period >> 32) * sequencer.gatePercentage);
+  clockOut.moveNextStep(stepClock.getNextStep());
+}
+
+void followClock()
+{
+  int64_t at;
+  while (externalClock.nextPulse(at))
+  {
+    if (clockSource == ClockExternal)
+      followPulse(clockFollower, at);
+  }
+  if (clockSource != ClockInternal)
+    activeFollower().expire(esp_timer_get_time());
+}
+
+// Sequencer task, at the event's time
+void applyMidi(const MidiEvent &event, int64_t at)
+{
+  Command cmd = {OP_PlayStop, Play, 0};
+  uint8_t type = event.status < 0xF0 ? event.status & 0xF0 : event.status;
+
+  switch (type)
+  {
+  case MIDI_NOTE_ON:
+    if (event.data2 > 0)
+    {
+      if (event.data1 < MIDI_NOTE_BASE || calibrating)
         break;
-      }
+      // held until its Note Off, the step clock's gate-off leaves it open
+      sequencer.holdNote(event.data1 - MIDI_NOTE_BASE);
       break;
+    }
+    // velocity 0 is a note off, fall through
+  case MIDI_NOTE_OFF:
+    if (event.data1 >= MIDI_NOTE_BASE)
+      sequencer.releaseNote(event.data1 - MIDI_NOTE_BASE);
+    break;
 
-    default:
-      break;
+  case MIDI_CLOCK:
+    if (clockSource == ClockMidi)
+      followPulse(midiFollower, at);
+    break;
+
+  case MIDI_START:
+    cmd.arg = Stop;
+    sequencer.applyCommand(cmd);
+    cmd.arg = Play;
+    sequencer.applyCommand(cmd);
+    midiFollower.rewind();
+    break;
+
+  case MIDI_CONTINUE:
+    sequencer.applyCommand(cmd);
+    break;
+
+  case MIDI_STOP:
+    cmd.arg = Pause;
+    sequencer.applyCommand(cmd);
+    break;
+
+  default:
+    break;
+  }
+}
+
+// Sequencer task, after commands and clock pulses, so a new tempo reaches the step clock at once
+void updateInterval()
+{
+  // a locked external clock sets the period itself, the internal tempo applies again once it is lost
+  bool following = clockSource != ClockInternal && activeFollower().locked();
+  uint32_t tempo = sequencer.centiBpm();
+  if (following == clockFollowing && tempo == clockTempo && sequencer.subdivision == clockSubdivision &&
+      sequencer.gatePercentage == clockGatePercentage)
+    return;
+  clockFollowing = following;
+  clockTempo = tempo;
+  clockSubdivision = sequencer.subdivision;
+  clockGatePercentage = sequencer.gatePercentage;
+  if (!following)
+    stepClock.setPeriod(sequencer.stepPeriod(), sequencer.gateLength());
+}
+
+// Sequencer task: queue what the BLE tasks handed over, run what is due, and
+// arm the event timer for whatever comes next
+void runScheduled()
+{
+  TimedMidi timed;
+  while (midiQueue.pop(timed))
+  {
+    if (!midiPending.push(timed.at, timed.event))
+      midiDropped++;
+  }
+
+  int64_t now = esp_timer_get_time();
+  MidiEvent event;
+  int64_t at;
+  while (midiPending.popDue(now, event, at))
+  {
+    if (now - at > MIDI_LATE_US)
+      midiLate++;
+    applyMidi(event, at);
+  }
+
+  // commands, timed ones included
+  sequencer.drain();
+  updateInterval();
+  // a start arms the first clock output pulse before its step fires
+  clockOut.setRunning(sequencer.playing(), stepClock.getNextStep(), stepClock.getPeriod(), sequencer.subdivision);
+
+  esp_timer_stop(eventTimer);
+  int64_t wait = midiPending.nextTime();
+  if (wait != INT64_MAX)
+    wait -= esp_timer_get_time();
+  int64_t commandWait = sequencer.untilDue();
+  if (commandWait < wait)
+    wait = commandWait;
+  if (wait != INT64_MAX)
+    esp_timer_start_once(eventTimer, wait > 1 ? wait : 1);
+}
+
+void onEventTimer(void *arg)
+{
+  xTaskNotify(sequencerTaskHandle, EVT_TIMER, eSetBits);
+}
+
+void sequencerTask(void *param)
+{
+  uint32_t events;
+  for (;;)
+  {
+    xTaskNotifyWait(0, EVT_STEP | EVT_GATE_OFF | EVT_COMMAND | EVT_CLOCK | EVT_RESET | EVT_MIDI | EVT_TIMER, &events,
+                    portMAX_DELAY);
+
+    if (events & EVT_RESET)
+    {
+      sequencer.rewind();
+      clockFollower.rewind();
     }
+    if (events & (EVT_CLOCK | EVT_STEP))
+      followClock();
+    if (events & EVT_GATE_OFF)
+      sequencer.gateOff();
+    if (events & EVT_STEP)
+      sequencer.step();
+    // MIDI events, queued and timed commands, and the next timer wake-up
+    runScheduled();
   }
-};
+}
 
-void playNote(int voltage)
+bool validAudioSettings(const AudioSettings &settings)
 {
-  gate = true;
-  digitalWrite(GATE_PIN, HIGH);
-  if (voltage <= 4000)
+  return settings.blockSize >= AUDIO_BLOCK_MIN && settings.blockSize <= AUDIO_BLOCK_MAX &&
+         settings.dmaBuffers >= I2S_DMA_BUFFERS_MIN && settings.dmaBuffers <= I2S_DMA_BUFFERS_MAX &&
+         settings.dmaFrames >= I2S_DMA_FRAMES_MIN && settings.dmaFrames <= I2S_DMA_FRAMES_MAX &&
+         settings.interpolation <= VoiceMixer::Hermite;
+}
+
+void loadAudioSettings()
+{
+  AudioSettings stored;
+  preferences.begin("owl", true);
+  size_t length = preferences.getBytes("audio", &stored, sizeof(AudioSettings));
+  preferences.end();
+  if (length == sizeof(AudioSettings) && validAudioSettings(stored))
+    audioSettings = stored;
+}
+
+// Audio task: (re)starts the output with audioSettings. The DMA buffers only
+// change by reinstalling the driver, which drops what they held.
+bool startAudio()
+{
+  voices.setInterpolation((VoiceMixer::Interpolation)audioSettings.interpolation);
+  pipeline.setBlockSize(audioSettings.blockSize);
+  pipeline.restart();
+  bool started = i2sOut.begin(sampleRate, audioSettings.dmaBuffers, audioSettings.dmaFrames);
+  uint32_t queued = (uint32_t)audioSettings.dmaBuffers * audioSettings.dmaFrames + audioSettings.blockSize;
+  Serial.printf("Audio: %u frame blocks, %u x %u DMA frames, %u us output latency%s\n", audioSettings.blockSize,
+                audioSettings.dmaBuffers, audioSettings.dmaFrames, (uint32_t)((uint64_t)queued * 1000000 / sampleRate),
+                started ? "" : ", I2S failed");
+  return started;
+}
+
+void sendAudioReport()
+{
+  uint32_t worst = pipeline.worstBlockUs();
+  if (worst > UINT16_MAX)
+    worst = UINT16_MAX;
+  uint8_t report[AUDIO_REPORT_LENGTH];
+  report[0] = OP_Audio;
+  report[1] = audioSettings.blockSize;
+  report[2] = audioSettings.dmaBuffers;
+  report[3] = audioSettings.dmaFrames / 8;
+  putLE32(report + 4, pipeline.underruns());
+  putLE32(report + 8, pipeline.lateBlocks());
+  report[12] = worst & 0xFF;
+  report[13] = worst >> 8;
+  report[14] = audioSettings.interpolation;
+  sendMessage(report, sizeof(report));
+}
+
+// Audio task, between blocks
+void applyAudioCommand(const Command &cmd)
+{
+  AudioSettings wanted = audioSettings;
+  switch (cmd.arg)
   {
-    mcp.setChannelValue(MCP4728_CHANNEL_C, voltage, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
-    //dac.setVoltageB(0);
-    // dac.setVoltageA(voltage);
+  case AudioReset:
+    pipeline.resetCounters();
+    break;
+  case AudioBlockSize:
+    wanted.blockSize = cmd.value;
+    break;
+  case AudioDmaBuffers:
+    wanted.dmaBuffers = cmd.value;
+    break;
+  case AudioDmaFrames:
+    wanted.dmaFrames = cmd.value * 8;
+    break;
+  case AudioInterpolation:
+    wanted.interpolation = cmd.value;
+    break;
+  default:
+    break;
   }
+  // out of range settings are ignored, the report tells the app what is in use
+  if (!validAudioSettings(wanted))
+    wanted = audioSettings;
+  bool output = wanted.blockSize != audioSettings.blockSize || wanted.dmaBuffers != audioSettings.dmaBuffers ||
+                wanted.dmaFrames != audioSettings.dmaFrames;
+  if (output || wanted.interpolation != audioSettings.interpolation)
+  {
+    audioSettings = wanted;
+    // the interpolation applies from the next block, the output keeps playing
+    if (output)
+      startAudio();
+    else
+      voices.setInterpolation((VoiceMixer::Interpolation)audioSettings.interpolation);
+    preferences.begin("owl", false);
+    preferences.putBytes("audio", &audioSettings, sizeof(AudioSettings));
+    preferences.end();
+  }
+  sendAudioReport();
+}
+
+void audioTask(void *param)
+{
+  Command cmd;
+  startAudio();
+  for (;;)
+  {
+    while (audioCommands.pop(cmd))
+      applyAudioCommand(cmd);
+    // paced by the DMA: the write blocks while all buffers are full. Without
+    // an output nothing blocks, so give the core back.
+    if (!pipeline.run())
+      vTaskDelay(1);
+  }
+}
+
+// Sequencer task: every played step starts a voice, pitched by its note
+void onStepNote(uint8_t step, uint8_t note)
+{
+  voices.trigger((int)note - SAMPLE_ROOT_NOTE, VOICE_STEP_GAIN);
+}
+
+// Lock state, phase error and followed tempo for monitoring the external clock
+void sendClockStatus()
+{
+  ClockFollower &follower = activeFollower();
+  int32_t error = follower.phaseError();
+  if (error > INT16_MAX)
+    error = INT16_MAX;
+  else if (error < INT16_MIN)
+    error = INT16_MIN;
+  uint32_t tempo = follower.centiBpm();
+  if (tempo > UINT16_MAX)
+    tempo = UINT16_MAX;
+
+  uint8_t status[6];
+  status[0] = OP_Clock;
+  status[1] = follower.locked();
+  status[2] = (uint16_t)error & 0xFF;
+  status[3] = (uint16_t)error >> 8;
+  status[4] = tempo & 0xFF;
+  status[5] = tempo >> 8;
+  notifier.post(status, sizeof(status));
+}
+
+// GAP events are not forwarded by BLEServer, this is the only place to see the final parameters
+void gapHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+  if (event == ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT)
+  {
+    connInterval = param->update_conn_params.conn_int;
+    connLatency = param->update_conn_params.latency;
+    statusChanged = true;
+  }
+}
+
+void requestConnParams(bool lowLatency)
+{
+  if (lowLatency)
+    pServer->updateConnParams(peerAddress, PLAY_MIN_INTERVAL, PLAY_MAX_INTERVAL, PLAY_LATENCY, PLAY_TIMEOUT);
   else
+    pServer->updateConnParams(peerAddress, IDLE_MIN_INTERVAL, IDLE_MAX_INTERVAL, IDLE_LATENCY, IDLE_TIMEOUT);
+  lowLatencyParams = lowLatency;
+}
+
+void sendStatus()
+{
+  uint8_t status[6];
+  status[0] = OP_Status;
+  status[1] = negotiatedMtu & 0xFF;
+  status[2] = negotiatedMtu >> 8;
+  status[3] = connInterval & 0xFF;
+  status[4] = connInterval >> 8;
+  status[5] = connLatency;
+  notifier.post(status, sizeof(status));
+
+  // one packet per connection event
+  uint32_t period = connInterval * 1250;
+  notifier.setMinPeriod(period > NOTIFY_MIN_PERIOD_US ? period : NOTIFY_MIN_PERIOD_US);
+}
+
+// A ping arrived on a connection event and its reply can only leave on a later
+// one, so the reply is stamped with that event rather than with now. The app
+// then sees about the same delay both ways and can take the midpoint
+uint32_t syncTransmitTime(uint32_t arrival)
+{
+  uint32_t now = micros();
+  uint32_t period = connInterval * 1250;
+  if (period == 0)
+    return now;
+  return arrival + ((now - arrival) / period + 1) * period;
+}
+
+// BLE task: everything the sequencer task handed over in pingQueue
+void answerPings()
+{
+  Ping ping;
+  while (pingQueue.pop(ping))
   {
-    voltage = voltage - 4000;
-    mcp.setChannelValue(MCP4728_CHANNEL_D, voltage, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
-    //dac.setVoltageA(4000);
-    //dac.setVoltageB(voltage);
+    uint8_t reply[LATENCY_REPORT_LENGTH];
+    uint8_t length;
+    if (ping.op == OP_Sync)
+    {
+      uint32_t transmit = syncTransmitTime(ping.arrival);
+      reply[0] = OP_Sync;
+      reply[1] = ping.sequence;
+      putLE32(reply + 2, ping.arrival);
+      putLE32(reply + 6, transmit);
+      length = SYNC_REPLY_LENGTH;
+    }
+    else if (ping.op == OP_Ping)
+    {
+      startTime = ping.arrival;
+      currentTime = micros();
+      latency = currentTime - startTime;
+      pingLatency.add(latency);
+      reply[0] = OP_Ping;
+      reply[1] = ping.sequence;
+      putLE32(reply + 2, latency);
+      length = PING_REPLY_LENGTH;
+    }
+    else if (ping.sequence == LatencyReset)
+    {
+      pingLatency.reset();
+      continue;
+    }
+    else
+    {
+      uint32_t longest = pingLatency.max();
+      reply[0] = OP_Latency;
+      reply[1] = pingLatency.samples();
+      putLE32(reply + 2, longest);
+      for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+        reply[6 + i] = pingLatency.bucket(i);
+      length = LATENCY_REPORT_LENGTH;
+      Serial.printf("Ping latency: %u samples, p50 < %u us, p99 < %u us, max %u us\n", pingLatency.samples(),
+                    pingLatency.percentile(50), pingLatency.percentile(99), longest);
+    }
+    pTxCharacteristic->setValue(reply, length);
+    pTxCharacteristic->notify();
   }
-  //dac.updateDAC();
 }
 
-void setup()
+// BLE task: what the notifier merged, replaced and lost since boot
+void printNotifyStats()
 {
-  file = new AudioFileSourcePROGMEM(viola, sizeof(viola));
-  wav = new AudioGeneratorWAV();
-  out = new AudioOutputI2S();
-  out->SetGain(1);
-  out->SetPinout(33, 25, 32);
-  out->SetChannels(0);
-  wav->begin(file, out);
+  uint32_t total = notifier.packets() + notifier.replaced() + notifier.overflowed();
+  if (millis() - lastNotifyStats < NOTIFY_STATS_MS || total == reportedNotifies)
+    return;
+  lastNotifyStats = millis();
+  reportedNotifies = total;
+  Serial.printf("Notify: %u packets, %u merged, %u replaced, %u overflowed\n", notifier.packets(),
+                notifier.merged(), notifier.replaced(), notifier.overflowed());
+}
+
+// Sent once the client is subscribed, so the app never has to ask for it
+void pushState()
+{
+  uint8_t message[FRAME_HEADER_LENGTH + 2 + MAX_STEPS];
+
+  uint32_t tempo = sequencer.centiBpm();
+  message[0] = OP_Tempo;
+  message[1] = sequencer.bpm() > 255 ? 255 : sequencer.bpm();
+  notifier.post(message, 2);
+
+  message[0] = OP_TempoFine;
+  message[1] = tempo & 0xFF;
+  message[2] = tempo >> 8;
+  notifier.post(message, 3);
+
+  message[0] = OP_PlayStop;
+  message[1] = sequencer.transport();
+  notifier.post(message, 2);
+
+  message[0] = OP_Pattern;
+  message[1] = 2 + MAX_STEPS;
+  message[2] = 0; // start step
+  message[3] = 0; // flags
+  const int *steps = sequencer.pattern().frontSteps();
+  for (uint8_t i = 0; i < MAX_STEPS; i++)
+    message[4 + i] = steps[i];
+  notifier.post(message, sizeof(message));
+
+  message[0] = OP_Step;
+  message[1] = sequencer.position();
+  notifier.post(message, 2);
+
+  statusChanged = false;
+  sendStatus();
+}
+
+void bleTask(void *param)
+{
+  TxMessage msg;
+  uint8_t packet[BLE_MTU - 3];
+  for (;;)
+  {
+    switch (connection.update(millis(), deviceConnected, pTxCccd->getNotifications()))
+    {
+    case ConnectionFsm::StartAdvertising:
+      pServer->startAdvertising(); // restart advertising
+      Serial.println("start advertising");
+      break;
+    case ConnectionFsm::PushState:
+      pushState();
+      break;
+    default:
+      break;
+    }
+
+#if BLE_CAPTURE
+    CaptureRecord record;
+    static char line[CAPTURE_LINE_LENGTH]; // too big for this task's stack
+    while (captureQueue.pop(record))
+    {
+      if (formatRecord(record, line, sizeof(line)))
+        Serial.println(line);
+    }
+#endif
+
+    if (connection.ready())
+    {
+      if (sequencer.playing() != lowLatencyParams)
+        requestConnParams(sequencer.playing());
+      if (statusChanged)
+      {
+        statusChanged = false;
+        sendStatus();
+      }
+      if (clockSource != ClockInternal && millis() - lastClockStatus >= CLOCK_STATUS_MS)
+      {
+        lastClockStatus = millis();
+        sendClockStatus();
+      }
+    }
+
+    // wait for the sequencer, but wake up regularly to flush and follow connection changes
+    if (xQueueReceive(txQueue, &msg, pdMS_TO_TICKS(NOTIFY_POLL_MS)) == pdTRUE)
+    {
+      do
+      {
+        if (msg.length > 0)
+          notifier.post(msg.data, msg.length);
+      } while (xQueueReceive(txQueue, &msg, 0) == pdTRUE);
+    }
+
+    if (!connection.ready())
+    {
+      notifier.clear();
+      continue;
+    }
+    answerPings();
+    size_t length = notifier.poll(micros(), packet, negotiatedMtu - 3);
+    if (length > 0)
+    {
+      pTxCharacteristic->setValue(packet, length);
+      pTxCharacteristic->notify();
+    }
+    printNotifyStats();
+  }
+}
 
+void setup()
+{
   // We call the init() method to initialize the instance
 
   //dac.init();
@@ -268,11 +1034,72 @@ void setup()
 
   pinMode(FREQUENCY_PIN, INPUT);
   Serial.begin(115200);
+  if (!frequencyMeter.begin(FREQUENCY_PIN))
+    Serial.println("Failed to start frequency capture");
+
+#if SAMPLE_ON_SD
+  bool mounted = SD.begin(SD_CS_PIN);
+  StreamingSource *file = new StreamingSource(SD);
+#else
+  bool mounted = SPIFFS.begin();
+  StreamingSource *file = new StreamingSource(SPIFFS);
+#endif
+  uint32_t fileSamples = 0;
+  bool loaded = mounted && file->begin() && file->open(SAMPLE_PATH) &&
+                loadSample(file, SAMPLE_RAM_BYTES, sample, sampleRate, fileSamples);
+  file->close();
+  if (loaded)
+  {
+    Serial.printf("Sample %s: %s, %u samples at %u Hz (%.2f s), %u stream underruns\n", SAMPLE_PATH,
+                  sample.blocks != NULL ? "IMA ADPCM" : "PCM", sample.length, sampleRate,
+                  (float)sample.length / sampleRate, file->underruns());
+    if (fileSamples > sample.length)
+      Serial.printf("Sample cut to SAMPLE_RAM_BYTES (%u): the file has %u samples (%.2f s)\n", SAMPLE_RAM_BYTES,
+                    fileSamples, (float)fileSamples / sampleRate);
+  }
+  else
+    Serial.printf("Sample %s not playable (filesystem %s)\n", SAMPLE_PATH, mounted ? "mounted" : "not mounted");
+  // the voices play from RAM: the ring, chunk buffer and prefetch task are not needed any more
+  delete file;
+  // without a sample the voices play silence
+  voices.setSample(sample);
+  pipeline.setSampleRate(sampleRate);
+  pipeline.setSource(&voices);
+  pipeline.addEffect(&dcBlocker);
+  pipeline.setSink(&i2sOut);
+  loadAudioSettings();
+
+  // --------------- MCP4728 --------------------
+  // before BLE is up: without the DAC setup stops here, with nothing to connect to
+  Serial.println("Adafruit MCP4728 test!");
+
+  // Try to initialize!
+  if (!mcp.begin())
+  {
+    Serial.println("Failed to find MCP4728 chip");
+    while (1)
+    {
+      delay(10);
+    }
+  }
+  Serial.println("MCP4728 Found!");
+  mcp.setChannelValue(MCP4728_CHANNEL_A, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
+  mcp.setChannelValue(MCP4728_CHANNEL_B, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
+  mcp.setChannelValue(MCP4728_CHANNEL_C, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
+  mcp.setChannelValue(MCP4728_CHANNEL_D, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
+  mcp.saveToEEPROM();
+  // --------------- MCP4728 --------------------
 
   //sequencer
-  tInterval = millis();
+  sequencer.begin(defaultSequence, loadNoteTable(), sendMessage);
+  sequencer.setCommandHandler(handleCommand);
+  sequencer.setStepHandler(onStepNote);
+  updateInterval();
+  txQueue = xQueueCreate(TX_QUEUE_LENGTH, sizeof(TxMessage));
   // Create the BLE Device
   BLEDevice::init("UART Service");
+  BLEDevice::setMTU(BLE_MTU);
+  BLEDevice::setCustomGapHandler(gapHandler);
 
   // Create the BLE Server
   pServer = BLEDevice::createServer();
@@ -286,7 +1113,8 @@ void setup()
       CHARACTERISTIC_UUID_TX,
       BLECharacteristic::PROPERTY_NOTIFY);
 
-  pTxCharacteristic->addDescriptor(new BLE2902());
+  pTxCccd = new BLE2902();
+  pTxCharacteristic->addDescriptor(pTxCccd);
 
   BLECharacteristic *pRxCharacteristic = pService->createCharacteristic(
       CHARACTERISTIC_UUID_RX,
@@ -297,115 +1125,41 @@ void setup()
   // Start the service
   pService->start();
 
-  // Start advertising
+  BLEService *pMidiService = pServer->createService(MIDI_SERVICE_UUID);
+  BLECharacteristic *pMidiCharacteristic = pMidiService->createCharacteristic(
+      MIDI_CHARACTERISTIC_UUID,
+      BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE_NR | BLECharacteristic::PROPERTY_NOTIFY);
+  pMidiCharacteristic->addDescriptor(new BLE2902());
+  pMidiCharacteristic->setCallbacks(new MidiCallbacks());
+  pMidiService->start();
+
+  esp_timer_create_args_t eventTimerArgs = {};
+  eventTimerArgs.callback = &onEventTimer;
+  eventTimerArgs.name = "events";
+  esp_timer_create(&eventTimerArgs, &eventTimer);
+
+  // the write callbacks notify the sequencer task, so it must exist before anyone can connect
+  xTaskCreatePinnedToCore(sequencerTask, "sequencer", 4096, NULL, SEQUENCER_PRIORITY, &sequencerTaskHandle, SEQUENCER_CORE);
+  xTaskCreatePinnedToCore(audioTask, "audio", 4096, NULL, AUDIO_PRIORITY, &audioTaskHandle, AUDIO_CORE);
+  xTaskCreatePinnedToCore(bleTask, "ble", 4096, NULL, BLE_PRIORITY, &bleTaskHandle, BLE_CORE);
+
+  // Start advertising, MIDI apps only list devices that advertise the MIDI service
+  pServer->getAdvertising()->addServiceUUID(MIDI_SERVICE_UUID);
   pServer->getAdvertising()->start();
   Serial.println("Waiting a client connection to notify...");
 
-  // --------------- MCP4728 --------------------
-  Serial.println("Adafruit MCP4728 test!");
-
-  // Try to initialize!
-  if (!mcp.begin())
-  {
-    Serial.println("Failed to find MCP4728 chip");
-    while (1)
-    {
-      delay(10);
-    }
-  }
-  Serial.println("MCP4728 Found!");
-  mcp.setChannelValue(MCP4728_CHANNEL_A, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
-  mcp.setChannelValue(MCP4728_CHANNEL_B, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
-  mcp.setChannelValue(MCP4728_CHANNEL_C, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
-  mcp.setChannelValue(MCP4728_CHANNEL_D, 0, MCP4728_VREF_INTERNAL, MCP4728_GAIN_2X);
-  mcp.saveToEEPROM();
-  // --------------- MCP4728 --------------------
+  if (!clockOut.begin(CLOCK_OUT_PIN))
+    Serial.println("Failed to start clock output");
+  // the sequencer task must exist before the first step fires
+  if (!stepClock.begin(onStep, onGateOff))
+    Serial.println("Failed to start step clock");
+  if (!externalClock.begin(CLOCK_IN_PIN, RESET_IN_PIN, sequencerTaskHandle, EVT_CLOCK, EVT_RESET))
+    Serial.println("Failed to start clock inputs");
 }
 
 void loop()
 {
-  if (wav->isRunning())
-  {
-    if (!wav->loop())
-      wav->stop();
-  }
-  else
-  {
-    Serial.printf("WAV done\n");
-    delay(1000);
-  }
-  /*  if (deviceConnected)
-  {
-    pTxCharacteristic->setValue(&txValue, 1);
-    pTxCharacteristic->notify();
-    txValue++;
-    delay(1000); // bluetooth stack will go into congestion, if too many packets are sent
-  } */
-
-  // disconnecting
-  if (!deviceConnected && oldDeviceConnected)
-  {
-    // TODO usar timer envez de delay para no trancar la secuencia
-    delay(500);                  // give the bluetooth stack the chance to get things ready
-    pServer->startAdvertising(); // restart advertising
-    Serial.println("start advertising");
-    oldDeviceConnected = deviceConnected;
-  }
-  // connecting
-  if (deviceConnected && !oldDeviceConnected)
-  {
-    // Init, send status of sequencer
-    // do stuff here on connecting
-    delay(3000); // HACER TIMER!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-    txValue[0] = OP_Tempo;
-    txValue[1] = bpm;
-    pTxCharacteristic->setValue(txValue, 2);
-    pTxCharacteristic->notify();
-    oldDeviceConnected = deviceConnected;
-  }
-
-  squarePositive = digitalRead(FREQUENCY_PIN);
-  if (squarePositive && !squareAux)
-  {
-    T = float(micros() - tFreq) / 1000000;
-    frequency = 1 / T;
-    // FILTRO
-    frequency = prevFrequency * (1 - trustFactor) + frequency * trustFactor;
-    prevFrequency = frequency;
-    // FILTRO
-    tFreq = micros();
-    squareAux = true;
-  }
-  if (!squarePositive && squareAux)
-  {
-    squareAux = false;
-  }
-
-  interval = 60000 / (subdivision * bpm);
-  gateInterval = interval * gatePercentage;
-
-  if (play && gate && (millis() - tGate >= gateInterval))
-  {
-    tGate += gateInterval;
-    digitalWrite(GATE_PIN, LOW);
-  }
-  if (millis() - tInterval >= interval)
-  {
-    //Serial.println(frequency);
-    /* Serial.print(xPortGetCoreID()); */
-    tInterval += interval;
-    if (play)
-    {
-      /* dac.setVoltageA(sequence[stepIndex]);
-      dac.updateDAC(); */
-      playNote(sequence[stepIndex]);
-      txValue[0] = OP_Step;
-      txValue[1] = stepIndex;
-      pTxCharacteristic->setValue(txValue, 2);
-      pTxCharacteristic->notify();
-      stepIndex++;
-      if (stepIndex >= 16)
-        stepIndex = 0;
-    }
-  }
-}
\ No newline at end of file
+  // edges are captured in hardware, this only picks up the latest average
+  frequency = frequencyMeter.read();
+  delay(10);
+}
@@ -0,0 +1,267 @@
+/*
+   IMA ADPCM check and converter (pio run -e native_adpcm && .pio/build/native_adpcm/program [in.wav] [out.wav])
+
+   Encodes a 16-bit mono PCM WAV (default data/viola.wav) to IMA ADPCM with
+   IMA_BENCH_BLOCK byte blocks, decodes it again with imaDecodeBlock() and
+   reports the size and the signal to noise ratio. With out.wav the ADPCM
+   file is written too, ready for data/ or an SD card.
+
+   Then times the per sample work of both playback paths on the host:
+   - PCM: what AudioGeneratorWAV::loop() does, one GetBufferedData() call per
+     sample copying byte by byte out of its 128-byte read buffer
+   - ADPCM: what an IMA ADPCM voice does, ImaCursor::read() of VOICE_WINDOW
+     samples at a time from the blocks in RAM, then a copy per sample
+   Both hand every sample to the same virtual ConsumeSample(). Cycles come from
+   the TSC on x86 hosts, elsewhere ns are printed instead; the ratio is what
+   carries over to the ESP32, not the absolute numbers.
+*/
+
+#include <WavHeader.h>
+#include <ImaAdpcm.h>
+#include <VoiceMixer.h>
+
+#include "../common/Ticks.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define IMA_BENCH_BLOCK 512   // 1017 samples, 23 ms at 44.1 kHz
+#define WAV_READ_BUFFER 128   // AudioGeneratorWAV's buffSize
+#define BENCH_RUNS 20
+#define ADPCM_MIN_SNR_DB 25.0
+
+// Stand-in for AudioOutput, the call itself is part of both paths
+class Sink
+{
+public:
+  virtual ~Sink() {}
+  virtual bool ConsumeSample(int16_t sample[2])
+  {
+    sum += sample[0] + sample[1];
+    return true;
+  }
+  int64_t sum = 0;
+};
+
+// Stand-in for AudioFileSource::read() from a RAM buffer (the StreamingSource ring)
+struct Source
+{
+  const uint8_t *data;
+  size_t length;
+  size_t pos;
+  uint32_t read(void *out, uint32_t n)
+  {
+    if (n > length - pos)
+      n = length - pos;
+    memcpy(out, data + pos, n);
+    pos += n;
+    return n;
+  }
+};
+
+// AudioGeneratorWAV's GetBufferedData(), byte at a time
+struct PcmPath
+{
+  Source *file;
+  uint8_t buff[WAV_READ_BUFFER];
+  uint32_t buffLen = 0;
+  uint32_t buffPtr = 0;
+
+  bool get(int bytes, void *dest)
+  {
+    uint8_t *p = (uint8_t *)dest;
+    while (bytes--)
+    {
+      if (buffPtr >= buffLen)
+      {
+        buffPtr = 0;
+        buffLen = file->read(buff, sizeof(buff));
+      }
+      if (buffPtr >= buffLen)
+        return false;
+      *(p++) = buff[buffPtr++];
+    }
+    return true;
+  }
+
+  size_t run(Sink *out)
+  {
+    size_t n = 0;
+    int16_t sample[2];
+    while (get(2, &sample[0]))
+    {
+      sample[1] = sample[0];
+      out->ConsumeSample(sample);
+      n++;
+    }
+    return n;
+  }
+};
+
+// VoiceMixer::refill() on a voice at the original pitch
+struct AdpcmPath
+{
+  Source *file;
+  ImaCursor cursor;
+  int16_t samples[VOICE_WINDOW];
+
+  size_t run(Sink *out)
+  {
+    size_t total = imaSampleCount(file->length, IMA_BENCH_BLOCK);
+    int16_t sample[2];
+    cursor.start(file->data, IMA_BENCH_BLOCK);
+    for (size_t pos = 0; pos < total; pos += VOICE_WINDOW)
+    {
+      size_t count = total - pos < VOICE_WINDOW ? total - pos : VOICE_WINDOW;
+      cursor.read(pos, samples, count);
+      for (size_t i = 0; i < count; i++)
+      {
+        sample[0] = samples[i];
+        sample[1] = sample[0];
+        out->ConsumeSample(sample);
+      }
+    }
+    return total;
+  }
+};
+
+bool loadFile(const char *path, std::vector<uint8_t> &bytes)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return false;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    bytes.insert(bytes.end(), buffer, buffer + n);
+  fclose(f);
+  return true;
+}
+
+template <typename Path>
+double bench(Path &path, const uint8_t *data, size_t length, Sink *sink, size_t &samples)
+{
+  double best = 1e30;
+  for (int run = 0; run < BENCH_RUNS; run++)
+  {
+    Source source = {data, length, 0};
+    path.file = &source;
+    uint64_t start = ticks();
+    samples = path.run(sink);
+    double perSample = (double)(ticks() - start) / samples;
+    if (perSample < best)
+      best = perSample;
+  }
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  const char *inPath = argc > 1 ? argv[1] : "data/viola.wav";
+  const char *outPath = argc > 2 ? argv[2] : NULL;
+
+  std::vector<uint8_t> file;
+  WavFormat wav;
+  if (!loadFile(inPath, file) || !parseWavHeader(file.data(), file.size(), wav) ||
+      wav.format != WAV_FORMAT_PCM || wav.channels != 1 || wav.bitsPerSample != 16 ||
+      wav.dataOffset + wav.dataSize > file.size())
+  {
+    printf("%s: not a 16-bit mono PCM WAV\n", inPath);
+    return 1;
+  }
+  const uint8_t *pcmBytes = file.data() + wav.dataOffset;
+  size_t count = wav.dataSize / 2;
+  std::vector<int16_t> pcm(count);
+  for (size_t i = 0; i < count; i++)
+    pcm[i] = (int16_t)(pcmBytes[2 * i] | (pcmBytes[2 * i + 1] << 8));
+
+  // encode
+  std::vector<uint8_t> adpcm;
+  ImaState state = {0, 0};
+  uint8_t block[IMA_BENCH_BLOCK];
+  for (size_t pos = 0; pos < count; pos += imaSamplesPerBlock(IMA_BENCH_BLOCK))
+  {
+    size_t bytes = imaEncodeBlock(&pcm[pos], count - pos, state, block, IMA_BENCH_BLOCK);
+    adpcm.insert(adpcm.end(), block, block + bytes);
+  }
+
+  // decode and compare
+  std::vector<int16_t> decoded(count + imaSamplesPerBlock(IMA_BENCH_BLOCK));
+  size_t total = 0;
+  for (size_t pos = 0; pos < adpcm.size(); pos += IMA_BENCH_BLOCK)
+  {
+    size_t bytes = adpcm.size() - pos < IMA_BENCH_BLOCK ? adpcm.size() - pos : IMA_BENCH_BLOCK;
+    total += imaDecodeBlock(&adpcm[pos], bytes, &decoded[total]);
+  }
+  double signal = 0, noise = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    double error = (double)decoded[i] - pcm[i];
+    signal += (double)pcm[i] * pcm[i];
+    noise += error * error;
+  }
+  double snr = noise > 0 ? 10 * log10(signal / noise) : 99;
+
+  printf("%s: %zu samples at %u Hz\n", inPath, count, wav.sampleRate);
+  printf("  PCM %u bytes, IMA ADPCM %zu bytes (%.2fx smaller), %zu samples decoded, SNR %.1f dB\n", wav.dataSize,
+         adpcm.size(), (double)wav.dataSize / adpcm.size(), total, snr);
+
+  if (outPath)
+  {
+    uint8_t header[64];
+    size_t headerLength = writeImaWavHeader(header, wav.sampleRate, IMA_BENCH_BLOCK, count, adpcm.size());
+    FILE *f = fopen(outPath, "wb");
+    if (f == NULL)
+    {
+      printf("cannot write %s\n", outPath);
+      return 1;
+    }
+    fwrite(header, 1, headerLength, f);
+    fwrite(adpcm.data(), 1, adpcm.size(), f);
+    fclose(f);
+
+    std::vector<uint8_t> written;
+    WavFormat check;
+    bool readable = loadFile(outPath, written) && parseWavHeader(written.data(), written.size(), check) &&
+                    check.format == WAV_FORMAT_IMA_ADPCM && check.blockAlign == IMA_BENCH_BLOCK &&
+                    check.samplesPerBlock == imaSamplesPerBlock(IMA_BENCH_BLOCK) && check.dataSize == adpcm.size();
+    printf("  wrote %s (%s)\n", outPath, readable ? "header reads back" : "HEADER BROKEN");
+    if (!readable)
+      return 1;
+  }
+
+  Sink *sink = new Sink();
+  PcmPath pcmPath;
+  AdpcmPath adpcmPath;
+  size_t pcmSamples = 0, adpcmSamples = 0;
+  double pcmCost = bench(pcmPath, pcmBytes, wav.dataSize, sink, pcmSamples);
+  double adpcmCost = bench(adpcmPath, adpcm.data(), adpcm.size(), sink, adpcmSamples);
+
+  // the decoder alone, without the output call
+  double decodeCost = 1e30;
+  for (int run = 0; run < BENCH_RUNS; run++)
+  {
+    uint64_t start = ticks();
+    size_t n = 0;
+    for (size_t pos = 0; pos < adpcm.size(); pos += IMA_BENCH_BLOCK)
+    {
+      size_t bytes = adpcm.size() - pos < IMA_BENCH_BLOCK ? adpcm.size() - pos : IMA_BENCH_BLOCK;
+      n += imaDecodeBlock(&adpcm[pos], bytes, &decoded[n]);
+    }
+    double perSample = (double)(ticks() - start) / n;
+    if (perSample < decodeCost)
+      decodeCost = perSample;
+  }
+
+  printf("  %s per sample (best of %d):\n", TICKS_UNIT, BENCH_RUNS);
+  printf("    PCM, AudioGeneratorWAV path     %6.2f\n", pcmCost);
+  printf("    IMA ADPCM, ImaCursor windows    %6.2f\n", adpcmCost);
+  printf("    imaDecodeBlock() alone          %6.2f\n", decodeCost);
+  printf("  (checksum %lld)\n", (long long)sink->sum);
+
+  bool ok = total >= count && snr >= ADPCM_MIN_SNR_DB && pcmSamples == count && adpcmSamples >= count;
+  printf(ok ? "OK\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/*
+   Clock output check (pio run -e native_clockout && .pio/build/native_clockout/program)
+
+   Runs StepSchedule and PulseSchedule together on the virtual clock the way
+   StepClock and ClockOut do on the ESP32: every step hands its deadline and
+   period to the pulse schedule CHECK_DISPATCH_US after it fired, like the
+   esp_timer task does, and announces the step after it; CLOCK_OUT_PIN follows
+   poll() as in the timer interrupt. Every edge has to come from the schedule,
+   the late step callback must not move any of them. For every
+   pulse rate, subdivision and tempo below it checks that each beat carries
+   exactly ppqn pulses, that every rising edge is within CHECK_TOLERANCE_US
+   of beat start + k * beat / ppqn on the exact tempo grid, and that the high
+   time matches the configured width. Exits non-zero on any mismatch.
+*/
+
+#include <Arduino.h>
+#include <Defs.h>
+#include <StepSchedule.h>
+#include <PulseSchedule.h>
+
+#define CHECK_BEATS 64
+#define CHECK_TOLERANCE_US 2 // step deadline and pulse offset are each rounded down to whole us
+#define CHECK_WIDTH_US 5000
+#define CHECK_DISPATCH_US 300 // step callback behind its deadline, beyond the tolerance on purpose
+
+const uint8_t rates[] = {1, 2, 4, 24};
+const uint8_t subdivisions[] = {1, 2, 3, 4, 8};
+const uint32_t tempos[] = {100, 9000, 12000, 13333, 17450, 30000}; // 1/100 BPM
+
+int checkRun(uint8_t ppqn, uint8_t subdivision, uint32_t centiBpm)
+{
+  StepSchedule steps;
+  PulseSchedule pulses;
+  uint64_t period = StepSchedule::periodFor(centiBpm, subdivision);
+  steps.setPeriod(period, (period >> 32) / 2);
+  pulses.setRate(ppqn);
+  pulses.setWidth(CHECK_WIDTH_US);
+
+  VirtualPins::reset();
+  VirtualClock::set(0);
+  steps.start(0);
+
+  double beat = 6e9 / centiBpm;
+  double spacing = beat / ppqn;
+  uint32_t width = CHECK_WIDTH_US < spacing / 2 ? CHECK_WIDTH_US : (uint32_t)(spacing / 2);
+  int64_t first = steps.nextDeadline(); // beat 0 starts with the first step
+  uint32_t expected = CHECK_BEATS * ppqn;
+  uint32_t rises = 0;
+  uint64_t rose = 0;
+  int errors = 0;
+  int64_t fired = -1; // step whose callback is still on its way
+  int64_t firedNext = 0;
+
+  // the sequencer task arms the first step when the transport starts
+  pulses.expect(first, period, subdivision);
+  while (rises < expected)
+  {
+    int64_t now = steps.nextDeadline();
+    if (pulses.nextDeadline() < now)
+      now = pulses.nextDeadline();
+    if (fired >= 0 && fired + CHECK_DISPATCH_US < now)
+      now = fired + CHECK_DISPATCH_US;
+    VirtualClock::set(now);
+
+    int64_t stepDeadline, gateDeadline, riseDeadline, fallDeadline;
+    if (steps.poll(now, stepDeadline, gateDeadline) & StepSchedule::Step)
+    {
+      fired = stepDeadline;
+      firedNext = steps.nextStepDeadline();
+    }
+    if (fired >= 0 && now >= fired + CHECK_DISPATCH_US)
+    {
+      pulses.onStep(fired, steps.period(), subdivision);
+      pulses.expect(firedNext, steps.period(), subdivision);
+      fired = -1;
+    }
+
+    uint8_t events = pulses.poll(now, riseDeadline, fallDeadline);
+    if (events & PulseSchedule::Fall)
+    {
+      digitalWrite(CLOCK_OUT_PIN, LOW);
+      if (VirtualPins::lastChange(CLOCK_OUT_PIN) - rose != width)
+      {
+        if (errors++ < 3)
+          Serial.printf("  pulse %u: high for %llu us, expected %u\n", rises - 1,
+                        (unsigned long long)(VirtualPins::lastChange(CLOCK_OUT_PIN) - rose), width);
+      }
+    }
+    if (events & PulseSchedule::Rise)
+    {
+      digitalWrite(CLOCK_OUT_PIN, HIGH);
+      rose = VirtualPins::lastChange(CLOCK_OUT_PIN);
+      double exact = first + rises * spacing;
+      double error = rose - exact;
+      if (error > CHECK_TOLERANCE_US || error < -CHECK_TOLERANCE_US)
+      {
+        if (errors++ < 3)
+          Serial.printf("  pulse %u: rose at %llu, expected %.1f\n", rises, (unsigned long long)rose, exact);
+      }
+      rises++;
+    }
+  }
+
+  // the next beat starts with the next pulse, right on its step
+  int64_t end = first + (int64_t)(CHECK_BEATS * beat);
+  if (rose >= (uint64_t)end)
+  {
+    Serial.printf("  %u pulses ran past the end of beat %d\n", expected, CHECK_BEATS);
+    errors++;
+  }
+  if (errors > 0)
+    Serial.printf("FAILED: %u PPQN, %u steps per beat, %u.%02u BPM: %d errors\n", ppqn, subdivision,
+                  centiBpm / 100, centiBpm % 100, errors);
+  return errors;
+}
+
+int main()
+{
+  int runs = 0;
+  int failed = 0;
+  for (size_t r = 0; r < sizeof(rates); r++)
+    for (size_t s = 0; s < sizeof(subdivisions); s++)
+      for (size_t t = 0; t < sizeof(tempos) / sizeof(tempos[0]); t++)
+      {
+        runs++;
+        if (checkRun(rates[r], subdivisions[s], tempos[t]) > 0)
+          failed++;
+      }
+
+  Serial.printf("%d runs of %d beats, %d failed\n", runs, CHECK_BEATS, failed);
+  Serial.println(failed == 0 ? "OK" : "FAILED");
+  return failed == 0 ? 0 : 1;
+}
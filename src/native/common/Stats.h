@@ -0,0 +1,71 @@
+#ifndef NATIVE_STATS_H
+#define NATIVE_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+// Collects samples and prints min/p50/p99/max, host tools only
+class Stats
+{
+public:
+  void add(int64_t sample)
+  {
+    samples.push_back(sample);
+    sorted = false;
+  }
+  size_t count() const { return samples.size(); }
+  void clear() { samples.clear(); }
+
+  int64_t percentile(double p)
+  {
+    if (samples.empty())
+      return 0;
+    sort();
+    size_t index = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[index];
+  }
+  int64_t min() { return percentile(0); }
+  int64_t max() { return percentile(100); }
+
+  void print(const char *label)
+  {
+    printf("  %-22s n=%-6zu min=%-9lld p50=%-9lld p99=%-9lld max=%lld\n", label, count(),
+           (long long)min(), (long long)percentile(50), (long long)percentile(99), (long long)max());
+  }
+
+private:
+  void sort()
+  {
+    if (!sorted)
+      std::sort(samples.begin(), samples.end());
+    sorted = true;
+  }
+
+  std::vector<int64_t> samples;
+  bool sorted = false;
+};
+
+// Deterministic xorshift32 so every run with the same seed is identical
+class Rng
+{
+public:
+  explicit Rng(uint32_t seed) : state(seed ? seed : 1) {}
+  uint32_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  // uniform in [lo, hi]
+  uint32_t range(uint32_t lo, uint32_t hi) { return hi <= lo ? lo : lo + next() % (hi - lo + 1); }
+  bool chance(uint32_t percent) { return next() % 100 < percent; }
+
+private:
+  uint32_t state;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef NATIVE_TICKS_H
+#define NATIVE_TICKS_H
+
+#include <stdint.h>
+#include <chrono>
+
+// Finest counter the host has for micro benchmarks: TSC cycles on x86,
+// steady_clock ns elsewhere. Host tools only.
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICKS_UNIT "cycles"
+static inline uint64_t ticks() { return __rdtsc(); }
+#else
+#define TICKS_UNIT "ns"
+static inline uint64_t ticks()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+   Host entry point for the native environment (pio run -e native && .pio/build/native/program).
+
+   Runs the Sequencer against the stand-ins in lib/NativeHal: a virtual
+   microsecond clock instead of esp_timer, recorded pins and DAC writes, and a
+   BLE characteristic driven from here instead of a phone. Steps are scheduled
+   the same way StepClock does it, on absolute deadlines.
+   Exits non-zero if the CV or gate output does not match the pattern.
+*/
+
+#include <Arduino.h>
+#include <Adafruit_MCP4728.h>
+#include <BLECharacteristic.h>
+#include <Sequencer.h>
+#include <NoteTable.h>
+
+#define RUN_STEPS 64
+
+Adafruit_MCP4728 mcp;
+Sequencer sequencer(mcp);
+NoteTable notes;
+BLECharacteristic rxCharacteristic;
+BLECharacteristic txCharacteristic;
+uint32_t stepNotifications = 0;
+
+class RxCallbacks : public BLECharacteristicCallbacks
+{
+  void onWrite(BLECharacteristic *pCharacteristic)
+  {
+    sequencer.receive(pCharacteristic->getData(), pCharacteristic->getLength());
+  }
+};
+
+void sendMessage(const uint8_t *data, uint8_t length)
+{
+  txCharacteristic.setValue(data, length);
+  txCharacteristic.notify();
+  if (data[0] == OP_Step)
+    stepNotifications++;
+}
+
+void write(uint8_t op, uint8_t arg, uint8_t value)
+{
+  uint8_t message[MSG_LENGTH] = {op, arg, value};
+  rxCharacteristic.write(message, sizeof(message));
+}
+
+int main()
+{
+  buildDefaultTable(notes);
+  sequencer.begin(defaultSequence, &notes, sendMessage);
+  rxCharacteristic.setCallbacks(new RxCallbacks());
+
+  write(OP_Tempo, 119, 0); // 120 BPM
+  write(OP_PlayStop, Play, 0);
+
+  int errors = 0;
+  uint64_t nextStep = sequencer.stepInterval();
+  for (int i = 0; i < RUN_STEPS; i++)
+  {
+    VirtualClock::set(nextStep);
+    uint8_t position = sequencer.position();
+    sequencer.step();
+
+    const NoteCode &expected = notes.notes[defaultSequence[position]];
+    if (mcp.value[MCP4728_CHANNEL_C] != expected.c || mcp.value[MCP4728_CHANNEL_D] != expected.d)
+    {
+      Serial.printf("step %d: CV %u/%u, expected %u/%u\n", i, mcp.value[MCP4728_CHANNEL_C],
+                    mcp.value[MCP4728_CHANNEL_D], expected.c, expected.d);
+      errors++;
+    }
+    if (!sequencer.gateOpen() || VirtualPins::lastChange(GATE_PIN) != nextStep)
+    {
+      Serial.printf("step %d: gate did not open at %llu\n", i, (unsigned long long)nextStep);
+      errors++;
+    }
+
+    uint32_t interval = sequencer.stepInterval();
+    VirtualClock::set(nextStep + sequencer.gateLength() - 1);
+    sequencer.gateOff();
+    nextStep += interval;
+  }
+
+  Serial.printf("%d steps in %lu ms, %u DAC writes, %u step notifications, %lu dropped commands\n",
+                RUN_STEPS, millis(), mcp.writes, stepNotifications, (unsigned long)sequencer.droppedCommands());
+  Serial.println(errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
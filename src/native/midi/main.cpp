@@ -0,0 +1,201 @@
+/*
+   BLE-MIDI check (pio run -e native_midi && .pio/build/native_midi/program)
+
+   1. Parses hand written packets covering several messages per packet,
+      running status (with and without a new timestamp, and across
+      packets), real-time bytes, SysEx spanning packets, timestamp wrap
+      inside a packet and malformed input, and compares every event.
+   2. Plays a sender that emits a note every MIDI_CHECK_SPACING_US on its
+      own clock (drifting by MIDI_CHECK_DRIFT_PPM, running past the 13-bit
+      timestamp wrap) through connection-event delivery, and compares the
+      jitter of arrival times with the jitter of the times MidiTimeline
+      schedules the events at.
+   3. Holds a note on the Sequencer over several steps of the step clock,
+      stopped and playing, and checks that only its Note Off closes the gate
+      while step gates still close on their own.
+   Exits non-zero on a parse mismatch, a gate in the wrong state or if the
+   scheduled jitter exceeds MIDI_CHECK_MAX_JITTER_US.
+*/
+
+#include <Arduino.h>
+#include <BleMidi.h>
+#include <Adafruit_MCP4728.h>
+#include <Sequencer.h>
+#include <NoteTable.h>
+#include "../common/Stats.h"
+
+#define MIDI_CHECK_EVENTS 4000
+#define MIDI_CHECK_SPACING_US 10000
+#define MIDI_CHECK_DRIFT_PPM 50
+#define MIDI_CHECK_INTERVAL_US 15000 // connection interval
+#define MIDI_CHECK_RADIO_US 1500     // extra delay: retransmissions, host stack
+#define MIDI_CHECK_MAX_JITTER_US 1500 // timestamps have 1 ms resolution
+#define MIDI_CHECK_SEED 4242
+
+struct ParseCase
+{
+  const char *name;
+  uint8_t packet[16];
+  size_t length;
+  int expected; // number of events, -1 = malformed
+  MidiEvent events[4];
+};
+
+const ParseCase parseCases[] = {
+    {"note on", {0x80, 0x81, 0x90, 60, 100}, 5, 1, {{0x01, 0x90, 60, 100}}},
+    {"two messages", {0x81, 0x85, 0x90, 60, 100, 0x86, 0x80, 60, 0}, 9, 2, {{0x85, 0x90, 60, 100}, {0x86, 0x80, 60, 0}}},
+    {"running status, same timestamp", {0x80, 0x80, 0x91, 60, 100, 62, 90}, 7, 2, {{0x00, 0x91, 60, 100}, {0x00, 0x91, 62, 90}}},
+    {"running status, new timestamp", {0x80, 0x80, 0x91, 60, 100, 0x8A, 62, 90}, 8, 2, {{0x00, 0x91, 60, 100}, {0x0A, 0x91, 62, 90}}},
+    {"running status from the last packet", {0x80, 0x8B, 64, 80}, 4, 1, {{0x0B, 0x91, 64, 80}}},
+    {"real-time inside running status", {0x80, 0x80, 0x90, 60, 100, 0x81, 0xF8, 0x82, 61, 100}, 10, 3,
+     {{0x00, 0x90, 60, 100}, {0x01, 0xF8, 0, 0}, {0x02, 0x90, 61, 100}}},
+    {"timestamp wraps inside packet", {0xBF, 0xFF, 0xFA, 0x81, 0xF8}, 5, 2, {{0x1FFF, 0xFA, 0, 0}, {0x0001, 0xF8, 0, 0}}},
+    {"program change", {0x80, 0x80, 0xC0, 5, 0x81, 0xB0, 7, 127}, 8, 2, {{0x00, 0xC0, 5, 0}, {0x01, 0xB0, 7, 127}}},
+    {"sysex start", {0x80, 0x80, 0xF0, 0x7E, 0x7F, 0x09}, 6, 0, {}},
+    {"sysex end, then clock", {0x80, 0x01, 0x02, 0x81, 0xF7, 0x82, 0xF8}, 7, 1, {{0x02, 0xF8, 0, 0}}},
+    {"sysex cancels running status", {0x80, 0x80, 0xF0, 0x01, 0x81, 0xF7, 0x82, 60, 100}, 9, -1, {}},
+    {"no header", {0x90, 60, 100}, 3, -1, {}},
+    {"truncated note", {0x80, 0x80, 0x90, 60}, 4, -1, {}},
+    {"timestamp without message", {0x80, 0x80, 0xF8, 0x81}, 4, -1, {}},
+};
+
+int checkParser()
+{
+  BleMidiParser parser;
+  int errors = 0;
+  for (size_t i = 0; i < sizeof(parseCases) / sizeof(parseCases[0]); i++)
+  {
+    const ParseCase &c = parseCases[i];
+    MidiEvent events[8];
+    int n = parser.parse(c.packet, c.length, events, 8);
+    bool ok = n == c.expected;
+    for (int e = 0; ok && e < n; e++)
+    {
+      ok = events[e].timestamp == c.events[e].timestamp && events[e].status == c.events[e].status &&
+           events[e].data1 == c.events[e].data1 && events[e].data2 == c.events[e].data2;
+    }
+    if (!ok)
+    {
+      Serial.printf("parse \"%s\": %d events, expected %d\n", c.name, n, c.expected);
+      errors++;
+    }
+  }
+  Serial.printf("%zu parse cases, %d failed\n", sizeof(parseCases) / sizeof(parseCases[0]), errors);
+  return errors;
+}
+
+int checkTimeline()
+{
+  Rng rng(MIDI_CHECK_SEED);
+  MidiTimeline timeline;
+  Stats arrival, scheduled;
+  int64_t nextEvent = 0;     // device us the sender plays the next note at
+  int64_t nextConnection = 0;
+  int64_t firstSent = -1, firstArrival = 0, firstScheduled = 0;
+  int sent = 0;
+
+  while (sent < MIDI_CHECK_EVENTS)
+  {
+    nextConnection += MIDI_CHECK_INTERVAL_US;
+    // everything played since the last connection event goes out in one packet
+    while (sent < MIDI_CHECK_EVENTS && nextEvent < nextConnection)
+    {
+      int64_t at = nextConnection + rng.range(0, MIDI_CHECK_RADIO_US);
+      // the sender's millisecond clock runs MIDI_CHECK_DRIFT_PPM fast
+      uint16_t timestamp = (uint16_t)((nextEvent + nextEvent * MIDI_CHECK_DRIFT_PPM / 1000000) / 1000 % MIDI_TIMESTAMP_MODULO);
+      timeline.onPacket(at, timestamp);
+      int64_t when = timeline.toDevice(timestamp);
+
+      if (firstSent < 0)
+      {
+        firstSent = nextEvent;
+        firstArrival = at;
+        firstScheduled = when;
+      }
+      // deviation from the sender's spacing, relative to the first event
+      arrival.add((at - firstArrival) - (nextEvent - firstSent));
+      scheduled.add((when - firstScheduled) - (nextEvent - firstSent));
+      nextEvent += MIDI_CHECK_SPACING_US;
+      sent++;
+    }
+  }
+
+  Serial.printf("%d notes every %d us over %.1f s, %d us connection interval\n", MIDI_CHECK_EVENTS,
+                MIDI_CHECK_SPACING_US, nextEvent / 1e6, MIDI_CHECK_INTERVAL_US);
+  arrival.print("on arrival");
+  scheduled.print("scheduled");
+  int64_t spread = scheduled.percentile(99) - scheduled.percentile(1);
+  if (spread > MIDI_CHECK_MAX_JITTER_US)
+  {
+    Serial.printf("scheduled jitter %lld us beyond %d us\n", (long long)spread, MIDI_CHECK_MAX_JITTER_US);
+    return 1;
+  }
+  return 0;
+}
+
+Adafruit_MCP4728 mcp;
+Sequencer sequencer(mcp);
+NoteTable notes;
+
+int gateCase(const char *name, bool open)
+{
+  bool pin = digitalRead(GATE_PIN) == HIGH;
+  if (sequencer.gateOpen() == open && pin == open)
+    return 0;
+  Serial.printf("gate \"%s\": %s, expected %s\n", name, pin ? "open" : "closed", open ? "open" : "closed");
+  return 1;
+}
+
+// The firmware's step clock keeps firing gate-offs while stopped, and applyMidi()
+// maps Note On/Off to holdNote()/releaseNote()
+int checkHeldNote()
+{
+  buildDefaultTable(notes);
+  sequencer.begin(defaultSequence, &notes, NULL);
+  int errors = 0;
+
+  sequencer.holdNote(12);
+  for (int i = 0; i < 4; i++)
+  {
+    sequencer.step();
+    sequencer.gateOff();
+  }
+  errors += gateCase("held over four steps, stopped", true);
+  sequencer.releaseNote(13);
+  errors += gateCase("Note Off of another note", true);
+  sequencer.releaseNote(12);
+  errors += gateCase("its Note Off", false);
+
+  Command play = {OP_PlayStop, Play, 0, 0};
+  sequencer.applyCommand(play);
+  sequencer.step();
+  errors += gateCase("step while playing", true);
+  sequencer.gateOff();
+  errors += gateCase("step gate-off", false);
+
+  sequencer.holdNote(20);
+  sequencer.gateOff();
+  errors += gateCase("held while playing, step gate-off", true);
+  sequencer.step();
+  sequencer.gateOff();
+  errors += gateCase("next step takes the gate over", false);
+  sequencer.releaseNote(20);
+  errors += gateCase("Note Off after the takeover", false);
+
+  sequencer.holdNote(20);
+  sequencer.setMuted(true);
+  errors += gateCase("muted while held", false);
+  sequencer.setMuted(false);
+
+  Serial.printf("held note gate cases, %d failed\n", errors);
+  return errors;
+}
+
+int main()
+{
+  int errors = checkParser();
+  errors += checkTimeline();
+  errors += checkHeldNote();
+  Serial.println(errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*
+   Audio pipeline check (pio run -e native_pipeline && .pio/build/native_pipeline/program)
+
+   Runs AudioPipeline on a virtual clock against a modeled I2S output: a ring
+   of DMA buffers that plays at the nominal rate off by PIPE_DRIFT_PPM, frees
+   one whole buffer at a time and blocks the writer while it is full. The
+   source costs a fixed time per block and now and then stalls, like the
+   audio task does when the sequencer or a flash write takes the core.
+
+   The model knows when the output really ran dry; the pipeline only has its
+   clock and what it wrote. For every DMA setting the table shows the latency
+   the buffers add, the true underruns and the pipeline's count of them and of
+   late blocks. Exits non-zero if a late block count is off, or an underrun
+   count by more than PIPE_UNDERRUN_SLACK_PERMILLE (at least one): with the
+   smallest buffers a write can wait too briefly to re-anchor the estimate.
+*/
+
+#include <AudioPipeline.h>
+#include "../common/Stats.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#define PIPE_RATE 44100
+#define PIPE_SECONDS 120
+#define PIPE_DRIFT_PPM 150    // output crystal against esp_timer
+#define PIPE_RENDER_US_PER_FRAME 3 // a few voices, well under real time
+#define PIPE_STALL_PERCENT 2  // blocks that stall
+#define PIPE_STALL_MAX_US 12000
+#define PIPE_UNDERRUN_SLACK_PERMILLE 1
+#define PIPE_SEED 7
+
+int64_t now = 0;
+int64_t virtualClock() { return now; }
+
+// DMA ring that plays in real time. Underruns restart playback from the next write.
+class ModelOutput : public AudioBlockSink
+{
+public:
+  ModelOutput(uint32_t buffers, uint32_t frames, double ppm)
+      : buffers(buffers), frames(frames), rate(PIPE_RATE * (1 + ppm / 1e6)), written(0), playedBase(0),
+        playStart(-1), dry(0)
+  {
+  }
+
+  size_t write(const int16_t *block, size_t count) override
+  {
+    if (playStart < 0 || played() >= written)
+    {
+      if (playStart >= 0)
+        dry++;
+      playStart = now;
+      playedBase = written;
+    }
+    // wait for buffers to be freed until the block fits
+    while (written + count > released() + capacity())
+    {
+      double next = (floor(played() / frames) + 1) * frames;
+      now = playStart + (int64_t)ceil((next - playedBase) * 1e6 / rate);
+    }
+    written += count;
+    return count;
+  }
+  uint32_t capacity() const override { return buffers * frames; }
+  uint32_t bufferFrames() const override { return frames; }
+  uint32_t underruns() const { return dry; }
+
+private:
+  double played() const { return playedBase + (now - playStart) * rate / 1e6; }
+  uint64_t released() const { return (uint64_t)(played() / frames) * frames; }
+
+  uint32_t buffers;
+  uint32_t frames;
+  double rate;
+  uint64_t written;
+  uint64_t playedBase;
+  int64_t playStart;
+  uint32_t dry;
+};
+
+class ModelSource : public AudioBlockSource
+{
+public:
+  ModelSource() : rng(PIPE_SEED), late(0), blockUs(0) {}
+  void render(int16_t *block, size_t frames) override
+  {
+    int64_t took = frames * PIPE_RENDER_US_PER_FRAME;
+    if (rng.chance(PIPE_STALL_PERCENT))
+      took += rng.range(0, PIPE_STALL_MAX_US);
+    if (took > blockUs)
+      late++;
+    now += took;
+    for (size_t i = 0; i < frames; i++)
+      block[i] = 0;
+  }
+
+  Rng rng;
+  uint32_t late;
+  int64_t blockUs;
+};
+
+struct Setting
+{
+  uint32_t block;
+  uint32_t buffers;
+  uint32_t frames;
+};
+
+const Setting settings[] = {
+    {16, 2, 32},  {32, 2, 64},  {64, 2, 128}, {64, 4, 64},   {64, 8, 64},
+    {128, 4, 256}, {64, 6, 128}, {32, 16, 64}, {128, 8, 256}, {64, 16, 512},
+};
+
+int main()
+{
+  bool ok = true;
+  printf("%d s at %d Hz, output +-%d ppm, %d%% of blocks stall up to %d us\n", PIPE_SECONDS, PIPE_RATE,
+         PIPE_DRIFT_PPM, PIPE_STALL_PERCENT, PIPE_STALL_MAX_US);
+  printf("  block  dma        latency   drift  underruns  counted   late  counted  worst us\n");
+  for (const Setting &s : settings)
+  {
+    for (int sign = -1; sign <= 1; sign += 2)
+    {
+      now = 1000;
+      ModelOutput output(s.buffers, s.frames, sign * PIPE_DRIFT_PPM);
+      ModelSource source;
+      AudioPipeline pipeline(virtualClock);
+      pipeline.setSampleRate(PIPE_RATE);
+      pipeline.setBlockSize(s.block);
+      pipeline.setSource(&source);
+      pipeline.setSink(&output);
+      source.blockUs = pipeline.blockUs();
+
+      uint64_t total = (uint64_t)PIPE_SECONDS * PIPE_RATE / s.block;
+      for (uint64_t i = 0; i < total; i++)
+        pipeline.run();
+
+      int32_t off = (int32_t)pipeline.underruns() - (int32_t)output.underruns();
+      int32_t slack = output.underruns() * PIPE_UNDERRUN_SLACK_PERMILLE / 1000;
+      if (slack < 1)
+        slack = 1;
+      bool match = off <= slack && off >= -slack && pipeline.lateBlocks() == source.late;
+      ok = ok && match;
+      printf("  %5u  %2u x %-4u  %5.1f ms  %+5d  %9u  %7u  %5u  %7u  %8u%s\n", s.block, s.buffers, s.frames,
+             (s.buffers * s.frames + s.block) * 1000.0 / PIPE_RATE, sign * PIPE_DRIFT_PPM, output.underruns(),
+             pipeline.underruns(),
+             source.late, pipeline.lateBlocks(), pipeline.worstBlockUs(), match ? "" : "  MISMATCH");
+    }
+  }
+  printf(ok ? "OK\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/*
+   BLE write replayer (pio run -e native_replay && .pio/build/native_replay/program [capture] [speed])
+
+   Feeds a capture in the BleCapture format (see lib/Capture/BleCapture.h,
+   printed by the firmware with BLE_CAPTURE set to 1) into the same onWrite
+   path the firmware uses. Without a capture file, or with "-", a synthetic
+   heavy editing session is generated instead; its writes go through the
+   capture text format and back first, and it exits non-zero if one changes.
+
+   speed 0 (default) replays as fast as possible, 1 at the original pace,
+   N at N times the original pace. Sequencer steps run on the virtual clock
+   at the capture's timeline and the queue is drained after every write, like
+   the sequencer task does when onWrite notifies it.
+
+   Reports decoded commands per second and the host time spent per onWrite
+   call (p50/p99/max), plus drops when the queue could not keep up and
+   writes the capture had to cut (those cannot be replayed).
+*/
+
+#include <Arduino.h>
+#include <Adafruit_MCP4728.h>
+#include <BLECharacteristic.h>
+#include <Sequencer.h>
+#include <StepSchedule.h>
+#include <NoteTable.h>
+#include <BleCapture.h>
+#include "../common/Stats.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+#define SYNTHETIC_WRITES 20000
+#define SYNTHETIC_SEED 777
+#define CONNECTION_INTERVAL_US 7500
+
+typedef std::chrono::steady_clock HostClock;
+
+Adafruit_MCP4728 mcp;
+Sequencer sequencer(mcp);
+NoteTable notes;
+BLECharacteristic rxCharacteristic;
+Stats callbackNs;
+uint64_t callbackTotalNs = 0;
+
+class MyCallbacks : public BLECharacteristicCallbacks
+{
+  void onWrite(BLECharacteristic *pCharacteristic)
+  {
+    HostClock::time_point start = HostClock::now();
+    sequencer.receive(pCharacteristic->getData(), pCharacteristic->getLength());
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(HostClock::now() - start).count();
+    callbackNs.add(ns);
+    callbackTotalNs += ns;
+  }
+};
+
+void ignoreMessage(const uint8_t *data, uint8_t length) {}
+
+bool loadCapture(const char *path, std::vector<CaptureRecord> &records)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return false;
+  char line[CAPTURE_LINE_LENGTH + 2];
+  CaptureRecord record;
+  while (fgets(line, sizeof(line), file))
+  {
+    if (parseRecord(line, record))
+      records.push_back(record);
+  }
+  fclose(file);
+  return true;
+}
+
+// Bursts of writes on connection events, mostly single note edits with some
+// whole pattern uploads, tempo moves and transport changes mixed in
+void syntheticSession(std::vector<CaptureRecord> &records)
+{
+  Rng rng(SYNTHETIC_SEED);
+  uint32_t t = 0;
+  CaptureRecord record;
+  uint8_t message[MAX_STEPS * (FRAME_HEADER_LENGTH + AT_PAYLOAD_LENGTH)];
+
+  while (records.size() < SYNTHETIC_WRITES)
+  {
+    t += CONNECTION_INTERVAL_US;
+    uint32_t burst = rng.range(0, 4);
+    for (uint32_t i = 0; i < burst; i++)
+    {
+      uint32_t kind = rng.range(0, 99);
+      size_t length = MSG_LENGTH;
+      if (kind < 70)
+      {
+        message[0] = OP_Note;
+        message[1] = rng.range(0, MAX_STEPS - 1);
+        message[2] = rng.range(0, 84);
+      }
+      else if (kind < 80)
+      {
+        message[0] = OP_NoteBack;
+        message[1] = rng.range(0, MAX_STEPS - 1);
+        message[2] = rng.range(0, 84);
+      }
+      else if (kind < 90)
+      {
+        message[0] = OP_Pattern;
+        message[1] = 2 + MAX_STEPS;
+        message[2] = 0;
+        message[3] = PatternCommit | PatternAtBar;
+        for (uint8_t s = 0; s < MAX_STEPS; s++)
+          message[4 + s] = rng.range(0, 84);
+        length = FRAME_HEADER_LENGTH + 2 + MAX_STEPS;
+      }
+      else if (kind < 91)
+      {
+        // every step edited at its own time in one long write
+        length = 0;
+        for (uint8_t s = 0; s < MAX_STEPS; s++)
+        {
+          uint32_t at = t + i * 10 + s * 1000;
+          uint8_t *frame = message + length;
+          frame[0] = OP_At;
+          frame[1] = AT_PAYLOAD_LENGTH;
+          for (int b = 0; b < 4; b++)
+            frame[2 + b] = at >> (8 * b);
+          frame[6] = OP_Note;
+          frame[7] = s;
+          frame[8] = rng.range(0, 84);
+          length += FRAME_HEADER_LENGTH + AT_PAYLOAD_LENGTH;
+        }
+      }
+      else if (kind < 93)
+      {
+        message[0] = OP_Tempo;
+        message[1] = rng.range(99, 179);
+        message[2] = 0;
+      }
+      else if (kind < 95)
+      {
+        uint32_t tempo = rng.range(6000, 18000);
+        message[0] = OP_TempoFine;
+        message[1] = tempo & 0xFF;
+        message[2] = tempo >> 8;
+      }
+      else
+      {
+        message[0] = OP_PlayStop;
+        message[1] = rng.chance(80) ? Play : Pause;
+        message[2] = 0;
+      }
+      makeRecord(record, t + i * 10, message, length);
+      records.push_back(record);
+    }
+  }
+}
+
+// Every record through formatRecord and parseRecord, false if one comes back different
+bool roundTrip(const std::vector<CaptureRecord> &records)
+{
+  char line[CAPTURE_LINE_LENGTH];
+  for (const CaptureRecord &record : records)
+  {
+    CaptureRecord parsed;
+    if (formatRecord(record, line, sizeof(line)) == 0 || !parseRecord(line, parsed) ||
+        parsed.timestamp != record.timestamp || parsed.length != record.length ||
+        parsed.original != record.original || memcmp(parsed.data, record.data, record.length) != 0)
+    {
+      printf("capture format round trip failed: %s\n", line);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "-";
+  double speed = argc > 2 ? atof(argv[2]) : 0;
+
+  std::vector<CaptureRecord> records;
+  if (strcmp(path, "-") == 0)
+  {
+    syntheticSession(records);
+    printf("synthetic session: %zu writes\n", records.size());
+    if (!roundTrip(records))
+      return 1;
+  }
+  else if (!loadCapture(path, records))
+  {
+    printf("cannot read %s\n", path);
+    return 1;
+  }
+  else
+  {
+    printf("%s: %zu writes\n", path, records.size());
+  }
+  if (records.empty())
+    return 1;
+
+  buildDefaultTable(notes);
+  sequencer.begin(defaultSequence, &notes, ignoreMessage);
+  rxCharacteristic.setCallbacks(new MyCallbacks());
+
+  StepSchedule schedule;
+  schedule.setPeriod(sequencer.stepPeriod(), sequencer.gateLength());
+  schedule.start(0);
+
+  uint32_t cut = 0;
+  for (const CaptureRecord &record : records)
+    cut += record.cut() ? 1 : 0;
+  uint32_t first = records[0].timestamp;
+  HostClock::time_point wallStart = HostClock::now();
+
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    const CaptureRecord &record = records[i];
+    uint64_t at = (uint32_t)(record.timestamp - first);
+
+    // steps due before this write drain the queue, like the sequencer task would
+    while ((uint64_t)schedule.nextDeadline() <= at)
+    {
+      int64_t stepDeadline, gateDeadline;
+      VirtualClock::set(schedule.nextDeadline());
+      uint8_t events = schedule.poll(schedule.nextDeadline(), stepDeadline, gateDeadline);
+      if (events & StepSchedule::GateOff)
+        sequencer.gateOff();
+      if (events & StepSchedule::Step)
+      {
+        sequencer.step();
+        schedule.setPeriod(sequencer.stepPeriod(), sequencer.gateLength());
+      }
+    }
+
+    VirtualClock::set(at);
+    if (speed > 0)
+      std::this_thread::sleep_until(wallStart + std::chrono::microseconds((uint64_t)(at / speed)));
+    rxCharacteristic.write(record.data, record.length);
+    // the firmware wakes the sequencer task right after a successful write
+    sequencer.drain();
+  }
+
+  double wallSeconds = std::chrono::duration<double>(HostClock::now() - wallStart).count();
+  printf("replayed %.1f s of capture in %.3f s (speed %s)\n", (records.back().timestamp - first) / 1e6,
+         wallSeconds, speed > 0 ? argv[2] : "max");
+  printf("decoded %lu commands, %lu dropped (queue full)\n", (unsigned long)sequencer.receivedCommands(),
+         (unsigned long)sequencer.droppedCommands());
+  if (callbackTotalNs > 0)
+    printf("onWrite throughput %.0f commands/s of callback time\n",
+           sequencer.receivedCommands() * 1e9 / callbackTotalNs);
+  if (cut > 0)
+    printf("%lu writes were cut in the capture and rejected whole\n", (unsigned long)cut);
+  callbackNs.print("onWrite ns");
+  return 0;
+}
@@ -0,0 +1,344 @@
+/*
+   Step timing simulator (pio run -e native_sim && .pio/build/native_sim/program)
+
+   Runs the sequencer against the virtual microsecond clock and charges
+   realistic costs for the work that competes with it: WAV decoding, BLE write
+   callbacks, esp_timer dispatch, context switches and I2C transactions.
+   Two schedulers are compared on the same seeded workload:
+
+   legacy  the original loop(): millis() polling of tInterval/tGate behind
+           wav->loop(), including the delay(1000) once the WAV is done
+   current StepSchedule deadlines (what StepClock runs) waking the Sequencer
+
+   Reported per scenario: step onset error against the exact tempo grid,
+   step jitter (each gap between two onsets against the exact step length)
+   and gate length error against the intended gate, min/p50/p99/max in us.
+   Exits non-zero if the current scheduler exceeds SIM_MAX_ONSET_P99_US or
+   SIM_MAX_JITTER_P99_US, however busy the modeled loop() is.
+
+   The external clock scenarios feed a jittered master clock through
+   ClockFollower into StepSchedule::align(), like followClock() does, and
+   report pulses to lock, lock losses, PLL phase error and step onset error
+   against the master's exact grid (plus the mean input latency) once settled
+   (SIM_MAX_CLOCK_P99_US).
+*/
+
+#include <Arduino.h>
+#include <Adafruit_MCP4728.h>
+#include <Sequencer.h>
+#include <StepSchedule.h>
+#include <NoteTable.h>
+#include <ClockFollower.h>
+#include "../common/Stats.h"
+
+#define SIM_STEPS 512
+#define SIM_SEED 12345
+#define SIM_MAX_ONSET_P99_US 250
+#define SIM_MAX_JITTER_P99_US 150
+#define SIM_CLOCK_PPQN 4
+#define SIM_CLOCK_PULSES 1024
+#define SIM_CLOCK_SETTLE 64 // pulses left out of the statistics after lock and after a tempo jump
+#define SIM_MAX_CLOCK_P99_US 500
+
+// Per-iteration costs in us, measured ballparks for an ESP32 at 240 MHz
+struct CostModel
+{
+  uint32_t wavMinUs, wavMaxUs;       // one wav->loop() pass (fills the I2S DMA)
+  uint64_t wavLengthUs;              // how long the sample plays before "WAV done"
+  uint32_t bleWriteEveryUs;          // mean gap between app writes while editing
+  uint32_t bleCriticalUs;            // controller critical section that can delay esp_timer
+  uint32_t bleCriticalPercent;       // chance a timer dispatch hits one
+  uint32_t timerMinUs, timerMaxUs;   // esp_timer dispatch latency
+  uint32_t switchMinUs, switchMaxUs; // task notify + context switch into the sequencer
+  uint32_t applyUs;                  // applying one queued command
+  uint32_t i2cUs;                    // one MCP4728 transaction at 100 kHz
+  uint32_t notifyUs;                 // setValue + notify from the calling task
+};
+
+const CostModel defaultCosts = {
+    200, 3000,
+    6800000,
+    20000,
+    40, 10,
+    10, 40,
+    5, 15,
+    2,
+    450,
+    150};
+
+struct Scenario
+{
+  const char *name;
+  int bpmCode; // OP_Tempo argument, bpm - 1
+  uint8_t subdivision; // steps per beat
+  bool editing; // app streaming writes
+};
+
+const Scenario scenarios[] = {
+    {"120 BPM idle app", 119, 1, false},
+    {"133 BPM idle app", 132, 1, false},
+    {"133 BPM editing", 132, 1, true},
+    {"200 BPM editing", 199, 1, true},
+    {"120 BPM sixteenths", 119, 4, false},
+    {"133 BPM sixteenths", 132, 4, false},
+};
+
+struct ClockScenario
+{
+  const char *name;
+  uint32_t centiBpm;     // master tempo
+  uint32_t jumpCentiBpm; // master tempo for the second half
+  uint8_t subdivision;   // steps per beat
+  uint32_t jitterUs;     // interrupt latency spread on every pulse
+};
+
+const ClockScenario clockScenarios[] = {
+    {"clock 120 BPM, one step per pulse", 12000, 12000, 4, 200},
+    {"clock 133.33 BPM, two steps per pulse", 13333, 13333, 8, 200},
+    {"clock 120 -> 126 BPM", 12000, 12600, 4, 200},
+    {"clock 90 BPM", 9000, 9000, 4, 1000},
+};
+
+Adafruit_MCP4728 mcp;
+NoteTable notes;
+
+void ignoreMessage(const uint8_t *data, uint8_t length) {}
+
+// Exact step length, the grid both schedulers are measured against
+double exactInterval(int bpm, int subdivision) { return 60000000.0 / (subdivision * bpm); }
+
+void simulateLegacy(const Scenario &scenario, const CostModel &cost, Stats &onset, Stats &jitter, Stats &gateLength)
+{
+  Rng rng(SIM_SEED);
+  int bpm = scenario.bpmCode + 1;
+  float subdivision = scenario.subdivision;
+  int gatePercentage = 1;
+  int interval = 60000 / (subdivision * bpm);
+  int gateInterval = interval * gatePercentage;
+  unsigned long tInterval = 0;
+  unsigned long tGate = 0;
+  bool gate = false;
+  uint64_t t = 0;
+  uint64_t lastOnset = 0;
+  int steps = 0;
+
+  while (steps < SIM_STEPS)
+  {
+    // wav->loop(), or the once-per-pass delay(1000) after the sample ended
+    t += t < cost.wavLengthUs ? rng.range(cost.wavMinUs, cost.wavMaxUs) : 1000000;
+    unsigned long ms = t / 1000;
+
+    if (gate && (ms - tGate >= (unsigned long)gateInterval))
+    {
+      tGate += gateInterval;
+      gate = false;
+      gateLength.add((int64_t)(t - lastOnset) - (int64_t)(exactInterval(bpm, subdivision) * gatePercentage));
+    }
+    if (ms - tInterval >= (unsigned long)interval)
+    {
+      tInterval += interval;
+      if (steps > 0)
+        jitter.add((int64_t)(t - lastOnset) - (int64_t)exactInterval(bpm, subdivision));
+      lastOnset = t;
+      onset.add((int64_t)t - (int64_t)((steps + 1) * exactInterval(bpm, subdivision)));
+      gate = true;
+      t += cost.i2cUs + cost.notifyUs;
+      steps++;
+    }
+  }
+}
+
+void simulateCurrent(const Scenario &scenario, const CostModel &cost, Stats &onset, Stats &jitter, Stats &gateLength)
+{
+  Rng rng(SIM_SEED);
+  Sequencer sequencer(mcp);
+  StepSchedule schedule;
+
+  VirtualClock::set(0);
+  VirtualPins::reset();
+  mcp.transactionUs = cost.i2cUs;
+  sequencer.begin(defaultSequence, &notes, ignoreMessage);
+  sequencer.subdivision = scenario.subdivision;
+
+  uint8_t tempo[MSG_LENGTH] = {OP_Tempo, (uint8_t)scenario.bpmCode, 0};
+  uint8_t start[MSG_LENGTH] = {OP_PlayStop, Play, 0};
+  sequencer.receive(tempo, sizeof(tempo));
+  sequencer.receive(start, sizeof(start));
+  sequencer.drain();
+  // the sequencer task updates the step clock period right after the drain
+  int bpm = scenario.bpmCode + 1;
+  double exact = exactInterval(bpm, scenario.subdivision);
+  schedule.setPeriod(sequencer.stepPeriod(), sequencer.gateLength());
+  schedule.start(0);
+
+  uint64_t busyUntil = 0; // sequencer task still applying the last write
+  uint64_t nextWrite = rng.range(0, cost.bleWriteEveryUs * 2);
+  uint64_t lastOnset = 0;
+  uint8_t note = 0;
+  int steps = 0;
+
+  while (steps < SIM_STEPS)
+  {
+    int64_t deadline = schedule.nextDeadline();
+
+    // app writes before this deadline wake the sequencer task, which applies them right away
+    while (scenario.editing && nextWrite < (uint64_t)deadline)
+    {
+      uint8_t edit[MSG_LENGTH] = {OP_Note, (uint8_t)(note % MAX_STEPS), (uint8_t)(note % 48)};
+      note++;
+      if (sequencer.receive(edit, sizeof(edit)))
+      {
+        sequencer.drain();
+        busyUntil = nextWrite + cost.switchMaxUs + cost.applyUs;
+      }
+      nextWrite += rng.range(cost.bleWriteEveryUs / 2, cost.bleWriteEveryUs * 3 / 2);
+    }
+
+    uint64_t fired = deadline + rng.range(cost.timerMinUs, cost.timerMaxUs);
+    if (scenario.editing && rng.chance(cost.bleCriticalPercent))
+      fired += rng.range(0, cost.bleCriticalUs);
+
+    int64_t stepDeadline = 0, gateDeadline = 0;
+    uint8_t events = schedule.poll(fired, stepDeadline, gateDeadline);
+
+    if (fired < busyUntil)
+      fired = busyUntil;
+    // the sequencer preempts the audio task, WAV decoding does not delay it
+    VirtualClock::set(fired + rng.range(cost.switchMinUs, cost.switchMaxUs));
+    if (events & StepSchedule::GateOff)
+    {
+      sequencer.gateOff();
+      gateLength.add((int64_t)(VirtualPins::lastChange(GATE_PIN) - lastOnset) - (int64_t)exact);
+    }
+    if (events & StepSchedule::Step)
+    {
+      sequencer.step();
+      if (steps > 0)
+        jitter.add((int64_t)(VirtualPins::lastChange(GATE_PIN) - lastOnset) - (int64_t)exact);
+      lastOnset = VirtualPins::lastChange(GATE_PIN);
+      onset.add((int64_t)lastOnset - (int64_t)((steps + 1) * exact));
+      steps++;
+    }
+  }
+}
+
+// Returns false if the follower never locked
+bool simulateExternal(const ClockScenario &scenario, const CostModel &cost, Stats &phaseError, Stats &onset,
+                      int &lockPulse, int &lockLosses)
+{
+  Rng rng(SIM_SEED);
+  ClockFollower follower(SIM_CLOCK_PPQN);
+  StepSchedule schedule;
+  uint64_t internal = StepSchedule::periodFor(12000, scenario.subdivision);
+  schedule.setPeriod(internal, internal >> 33);
+  schedule.start(0);
+
+  double master = 1000000; // exact time of the next master pulse
+  double lastPulse = 0;
+  double pulseLength = 0;
+  int settledFrom = SIM_CLOCK_PULSES;
+  bool wasLocked = false;
+  lockPulse = -1;
+  lockLosses = 0;
+
+  for (int k = 0; k < SIM_CLOCK_PULSES; k++)
+  {
+    uint32_t centiBpm = k < SIM_CLOCK_PULSES / 2 ? scenario.centiBpm : scenario.jumpCentiBpm;
+    if (k == SIM_CLOCK_PULSES / 2 && centiBpm != scenario.centiBpm && lockPulse >= 0)
+      settledFrom = k + SIM_CLOCK_SETTLE;
+    double stepLength = 6e9 / centiBpm / scenario.subdivision;
+    int64_t handled = (int64_t)master + rng.range(0, scenario.jitterUs) + rng.range(cost.switchMinUs, cost.switchMaxUs);
+
+    // steps due before the pulse is handled, measured against the master grid
+    while (schedule.nextDeadline() < handled)
+    {
+      int64_t fired = schedule.nextDeadline() + rng.range(cost.timerMinUs, cost.timerMaxUs);
+      int64_t stepDeadline = 0, gateDeadline = 0;
+      if ((schedule.poll(fired, stepDeadline, gateDeadline) & StepSchedule::Step) && k >= settledFrom && k > 0)
+      {
+        // the mean input latency is common to every pulse, no follower can see it
+        double grid = lastPulse + scenario.jitterUs / 2;
+        grid += stepLength * (int64_t)((fired - grid) / stepLength + 0.5);
+        onset.add(fired - (int64_t)grid);
+      }
+    }
+
+    bool locked = follower.pulse(handled);
+    if (locked && k >= settledFrom)
+      phaseError.add(follower.phaseError());
+    if (locked && lockPulse < 0)
+    {
+      lockPulse = k;
+      settledFrom = k + SIM_CLOCK_SETTLE;
+    }
+    if (wasLocked && !locked)
+      lockLosses++;
+    wasLocked = locked;
+    if (locked && follower.onStep(scenario.subdivision))
+    {
+      uint64_t period = follower.stepPeriod(scenario.subdivision);
+      schedule.setPeriod(period, period >> 33);
+      schedule.align(follower.phase());
+    }
+
+    lastPulse = master;
+    pulseLength = 6e9 / centiBpm / SIM_CLOCK_PPQN;
+    master += pulseLength;
+  }
+  return lockPulse >= 0;
+}
+
+int main()
+{
+  buildDefaultTable(notes);
+  const CostModel &cost = defaultCosts;
+  int failures = 0;
+
+  printf("%d steps per scenario, seed %d, errors in us (positive = late)\n", SIM_STEPS, SIM_SEED);
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+  {
+    const Scenario &scenario = scenarios[i];
+    Stats legacyOnset, legacyJitter, legacyGate, currentOnset, currentJitter, currentGate;
+    simulateLegacy(scenario, cost, legacyOnset, legacyJitter, legacyGate);
+    simulateCurrent(scenario, cost, currentOnset, currentJitter, currentGate);
+
+    printf("\n%s\n", scenario.name);
+    legacyOnset.print("legacy onset");
+    legacyJitter.print("legacy step jitter");
+    legacyGate.print("legacy gate length");
+    currentOnset.print("current onset");
+    currentJitter.print("current step jitter");
+    currentGate.print("current gate length");
+
+    if (currentOnset.percentile(99) > SIM_MAX_ONSET_P99_US || currentOnset.percentile(99) < -SIM_MAX_ONSET_P99_US)
+    {
+      printf("  FAIL: current onset p99 beyond %d us\n", SIM_MAX_ONSET_P99_US);
+      failures++;
+    }
+    if (currentJitter.percentile(99) > SIM_MAX_JITTER_P99_US || currentJitter.percentile(1) < -SIM_MAX_JITTER_P99_US)
+    {
+      printf("  FAIL: current step jitter beyond %d us\n", SIM_MAX_JITTER_P99_US);
+      failures++;
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(clockScenarios) / sizeof(clockScenarios[0]); i++)
+  {
+    const ClockScenario &scenario = clockScenarios[i];
+    Stats phaseError, onset;
+    int lockPulse, lockLosses;
+    bool locked = simulateExternal(scenario, cost, phaseError, onset, lockPulse, lockLosses);
+
+    printf("\n%s, %u us jitter\n", scenario.name, scenario.jitterUs);
+    printf("  locked after %d pulses, lost lock %d times\n", lockPulse, lockLosses);
+    phaseError.print("PLL phase error");
+    onset.print("step onset");
+
+    if (!locked || onset.percentile(99) > SIM_MAX_CLOCK_P99_US || onset.percentile(99) < -SIM_MAX_CLOCK_P99_US)
+    {
+      printf("  FAIL: no lock or step onset p99 beyond %d us\n", SIM_MAX_CLOCK_P99_US);
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
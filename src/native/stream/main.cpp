@@ -0,0 +1,148 @@
+/*
+   Sample streaming check (pio run -e native_stream && .pio/build/native_stream/program [wav] [speed])
+
+   Streams a file (default data/viola.wav) through the same ByteRing the
+   firmware's StreamingSource uses. A producer thread stands in for the
+   prefetch task: it reads STREAM_CHUNK bytes at a time with a simulated
+   filesystem latency, including rare long stalls (SPIFFS garbage collection,
+   SD card housekeeping). The consumer pulls audio blocks at the real 44.1 kHz
+   16-bit mono rate, sped up by speed (default 10).
+
+   Reports the ring fill seen by the consumer and the underruns. Exits
+   non-zero if the data does not match the file byte for byte or the ring ever
+   ran dry.
+*/
+
+#include <ByteRing.h>
+#include "../common/Stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+
+// as in include/StreamingSource.h
+#define STREAM_RING_SIZE 32768
+#define STREAM_CHUNK 4096
+
+#define STREAM_BYTES_PER_SECOND 88200 // 44.1 kHz 16-bit mono
+#define STREAM_BLOCK 512              // what AudioGeneratorWAV asks for at a time
+#define STREAM_READ_MIN_US 1000
+#define STREAM_READ_MAX_US 4000
+#define STREAM_STALL_US 120000
+#define STREAM_STALL_PERCENT 2
+#define STREAM_SEED 4242
+
+typedef std::chrono::steady_clock HostClock;
+
+ByteRing<STREAM_RING_SIZE> ring;
+std::vector<uint8_t> source;
+std::atomic<bool> eof(false);
+std::atomic<bool> stop(false);
+double speed = 10;
+
+void sleepUs(int64_t us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(us / speed)));
+}
+
+void prefetch()
+{
+  Rng rng(STREAM_SEED);
+  size_t pos = 0;
+  uint32_t stalls = 0;
+  while (!stop)
+  {
+    if (pos >= source.size())
+    {
+      eof = true;
+      break;
+    }
+    if (ring.space() < STREAM_CHUNK)
+    {
+      sleepUs(1000);
+      continue;
+    }
+    int64_t latency = rng.range(STREAM_READ_MIN_US, STREAM_READ_MAX_US);
+    if (rng.chance(STREAM_STALL_PERCENT))
+    {
+      latency += STREAM_STALL_US;
+      stalls++;
+    }
+    sleepUs(latency);
+    size_t n = source.size() - pos < STREAM_CHUNK ? source.size() - pos : STREAM_CHUNK;
+    ring.write(&source[pos], n);
+    pos += n;
+  }
+  printf("  prefetch: %zu bytes, %u stalls of %d ms\n", pos, stalls, STREAM_STALL_US / 1000);
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "data/viola.wav";
+  if (argc > 2)
+    speed = atof(argv[2]);
+  if (speed <= 0)
+    speed = 1;
+
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    printf("cannot read %s\n", path);
+    return 1;
+  }
+  uint8_t buffer[STREAM_BLOCK];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    source.insert(source.end(), buffer, buffer + n);
+  fclose(f);
+  printf("%s: %zu bytes, %.1f s of audio, ring %d bytes (%d ms), speed %.0fx\n", path, source.size(),
+         source.size() / (double)STREAM_BYTES_PER_SECOND, STREAM_RING_SIZE,
+         STREAM_RING_SIZE * 1000 / STREAM_BYTES_PER_SECOND, speed);
+
+  std::thread producer(prefetch);
+
+  // give the prefetch task a head start like open() does before playback starts
+  while (ring.available() < STREAM_RING_SIZE / 2 && !eof)
+    sleepUs(1000);
+
+  Stats fillMs;
+  uint32_t underruns = 0;
+  size_t consumed = 0;
+  bool match = true;
+  int64_t blockUs = (int64_t)STREAM_BLOCK * 1000000 / STREAM_BYTES_PER_SECOND;
+  HostClock::time_point next = HostClock::now();
+  while (consumed < source.size())
+  {
+    // the ring drains at the end of the file, that is not a margin
+    if (!eof)
+      fillMs.add(ring.available() * 1000 / STREAM_BYTES_PER_SECOND);
+    size_t want = source.size() - consumed < STREAM_BLOCK ? source.size() - consumed : STREAM_BLOCK;
+    size_t got = ring.read(buffer, want);
+    if (got < want)
+    {
+      underruns++;
+      // like StreamingSource::read(), wait for the rest
+      while (got < want)
+      {
+        sleepUs(1000);
+        got += ring.read(buffer + got, want - got);
+      }
+      next = HostClock::now();
+    }
+    if (memcmp(buffer, &source[consumed], got) != 0)
+      match = false;
+    consumed += got;
+    next += std::chrono::microseconds((int64_t)(blockUs / speed));
+    std::this_thread::sleep_until(next);
+  }
+  stop = true;
+  producer.join();
+
+  fillMs.print("ring fill ms");
+  printf("  %zu bytes consumed, %s, %u underruns\n", consumed, match ? "identical" : "MISMATCH", underruns);
+  bool ok = match && underruns == 0;
+  printf(ok ? "OK\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+   Scheduled command check (pio run -e native_sync && .pio/build/native_sync/program)
+
+   Models the app side of OP_Sync/OP_At against the real Sequencer on the
+   virtual clock. The app clock has its own epoch and drifts by
+   SYNC_DRIFT_PPM. Writes and notifications only move at connection events,
+   with some extra radio delay, so both directions wait up to a connection
+   interval. The device stamps every ping on arrival and the BLE task stamps
+   the reply with the connection event it goes out on, like
+   syncTransmitTime() in the firmware. The app re-syncs
+   every SYNC_PERIOD_US with a few pings and keeps the one with the shortest
+   round trip net of the time spent on the device (NTP style). It then sends
+   every note SYNC_LEAD_US ahead, wrapped in OP_At.
+
+   Reports the error against the intended time of applying on arrival (what
+   plain writes get) and of the timed path, plus the residual the device
+   reports back. Exits non-zero if timed commands are late, spread over more
+   than SYNC_MAX_SPREAD_US (p1 to p99) or are off by more than SYNC_MAX_BIAS_US
+   in the median. Some bias is left: the app cannot see how long its ping sat
+   in its own queue or how long the device stack took to deliver it.
+*/
+
+#include <Arduino.h>
+#include <Adafruit_MCP4728.h>
+#include <BLECharacteristic.h>
+#include <Sequencer.h>
+#include <NoteTable.h>
+#include "../common/Stats.h"
+
+#include <vector>
+
+#define SYNC_NOTES 2000
+#define SYNC_NOTE_SPACING_US 125000
+#define SYNC_INTERVAL_US 15000 // connection interval
+#define SYNC_RADIO_US 1000     // air time and host stack per direction
+#define SYNC_RADIO_JITTER_US 300
+#define SYNC_WAKE_MIN_US 10    // esp_timer dispatch + switch into the sequencer task
+#define SYNC_WAKE_MAX_US 40
+#define SYNC_APP_EPOCH_US 123456789
+#define SYNC_DRIFT_PPM 30
+#define SYNC_PERIOD_US 5000000
+#define SYNC_PINGS 16
+#define SYNC_REPLY_MAX_US 200 // the sequencer task wakes the BLE task for every reply
+#define SYNC_LEAD_US 45000 // three connection intervals
+#define SYNC_MAX_SPREAD_US 2500
+#define SYNC_MAX_BIAS_US 1500
+#define SYNC_SEED 99
+
+Adafruit_MCP4728 mcp;
+Sequencer sequencer(mcp);
+NoteTable notes;
+BLECharacteristic rxCharacteristic;
+Rng rng(SYNC_SEED);
+
+struct SyncReply
+{
+  uint8_t sequence;
+  int64_t arrival;
+  int64_t handover; // when the BLE task notifies it
+};
+
+std::vector<SyncReply> outbox; // device -> app, each leaves at the first connection event after handover
+Stats residuals;
+std::vector<int64_t> applied; // device time every timed note was applied at, in order
+
+class RxCallbacks : public BLECharacteristicCallbacks
+{
+  void onWrite(BLECharacteristic *pCharacteristic)
+  {
+    // the firmware wakes the sequencer task right after a write
+    if (sequencer.receive(pCharacteristic->getData(), pCharacteristic->getLength()))
+      sequencer.drain();
+  }
+};
+
+void sendMessage(const uint8_t *data, uint8_t length)
+{
+  if (data[0] == OP_At)
+  {
+    residuals.add((int16_t)(data[2] | (data[3] << 8)));
+    applied.push_back(VirtualClock::now());
+  }
+}
+
+// What the firmware's handleCommand and BLE task do with a ping
+void handleCommand(const Command &cmd)
+{
+  if (cmd.op != OP_Sync)
+    return;
+  SyncReply reply = {cmd.arg, cmd.at, (int64_t)VirtualClock::now() + rng.range(0, SYNC_REPLY_MAX_US)};
+  outbox.push_back(reply);
+}
+
+int64_t radioDelay() { return SYNC_RADIO_US + rng.range(0, SYNC_RADIO_JITTER_US); }
+
+// App clock for a device time, and back
+int64_t appTime(int64_t device) { return SYNC_APP_EPOCH_US + device + device * SYNC_DRIFT_PPM / 1000000; }
+int64_t deviceTime(int64_t app) { return (app - SYNC_APP_EPOCH_US) * 1000000 / (1000000 + SYNC_DRIFT_PPM); }
+
+// Runs the timed commands that fall due before the clock moves on to until
+void runUntil(int64_t until)
+{
+  for (;;)
+  {
+    int64_t wait = sequencer.untilDue();
+    if (wait == INT64_MAX || (int64_t)VirtualClock::now() + wait > until)
+      break;
+    VirtualClock::advance((wait > 0 ? wait : 0) + rng.range(SYNC_WAKE_MIN_US, SYNC_WAKE_MAX_US));
+    sequencer.drain();
+  }
+  if ((int64_t)VirtualClock::now() < until)
+    VirtualClock::set(until);
+}
+
+struct Write
+{
+  int64_t arrival;
+  uint8_t data[FRAME_HEADER_LENGTH + AT_PAYLOAD_LENGTH];
+  uint8_t length;
+};
+
+int main()
+{
+  buildDefaultTable(notes);
+  sequencer.begin(defaultSequence, &notes, sendMessage);
+  sequencer.setCommandHandler(handleCommand);
+  rxCharacteristic.setCallbacks(new RxCallbacks());
+  VirtualClock::set(1000);
+
+  Stats onArrival, timed;
+  std::vector<int64_t> ideals;
+  int64_t offset = 0; // app estimate of app time - device time
+  int64_t bestDelay = INT64_MAX;
+  int64_t bestOffset = 0;
+  int64_t pingSent[SYNC_PINGS];
+  int pings = 0;
+  int64_t nextSync = 0;
+  int note = 0;
+  int64_t firstNote = 500000; // app time of the first note, relative to its epoch
+
+  for (int64_t event = SYNC_INTERVAL_US; note < SYNC_NOTES; event += SYNC_INTERVAL_US)
+  {
+    runUntil(event);
+
+    // app side of the connection event: replies from the device first
+    int64_t app = appTime(event + radioDelay());
+    for (size_t i = 0; i < outbox.size();)
+    {
+      const SyncReply &r = outbox[i];
+      if (r.handover >= event)
+      {
+        i++;
+        continue;
+      }
+      // only the low 32 bits travel, like in the reply
+      uint32_t arrival = (uint32_t)r.arrival;
+      uint32_t transmit = arrival + ((r.handover - r.arrival) / SYNC_INTERVAL_US + 1) * SYNC_INTERVAL_US;
+      int64_t sent = pingSent[r.sequence];
+      int64_t delay = (app - sent) - (int32_t)(transmit - arrival);
+      if (delay < bestDelay)
+      {
+        bestDelay = delay;
+        bestOffset = ((sent - arrival) + (app - transmit)) / 2;
+      }
+      // a round only replaces the estimate once all of its pings are back
+      if (r.sequence == SYNC_PINGS - 1)
+        offset = bestOffset;
+      outbox.erase(outbox.begin() + i);
+    }
+
+    std::vector<Write> writes;
+    if (appTime(event) >= nextSync && pings < SYNC_PINGS)
+    {
+      // queued by the app somewhere in the last interval
+      Write w = {event + radioDelay(), {OP_Sync, (uint8_t)pings, 0}, MSG_LENGTH};
+      pingSent[pings++] = appTime(event - rng.range(0, SYNC_INTERVAL_US));
+      writes.push_back(w);
+    }
+    else if (pings == SYNC_PINGS)
+    {
+      // the next round starts from scratch so drift does not pile up
+      nextSync = appTime(event) + SYNC_PERIOD_US;
+      pings = 0;
+      bestDelay = INT64_MAX;
+    }
+
+    // notes due within the lead time go out now; the first round of pings must be done
+    while (offset != 0 && note < SYNC_NOTES)
+    {
+      int64_t wanted = SYNC_APP_EPOCH_US + firstNote + (int64_t)note * SYNC_NOTE_SPACING_US;
+      if (wanted - SYNC_LEAD_US > appTime(event + SYNC_INTERVAL_US))
+        break;
+      uint32_t at = (uint32_t)(wanted - offset);
+      Write w = {event + radioDelay(),
+                 {OP_At, AT_PAYLOAD_LENGTH, (uint8_t)at, (uint8_t)(at >> 8), (uint8_t)(at >> 16), (uint8_t)(at >> 24),
+                  OP_Note, (uint8_t)(note % MAX_STEPS), (uint8_t)(note % 48)},
+                 FRAME_HEADER_LENGTH + AT_PAYLOAD_LENGTH};
+      writes.push_back(w);
+
+      // a plain write of the same note at its time would land at the next connection event
+      int64_t ideal = deviceTime(wanted);
+      ideals.push_back(ideal);
+      int64_t plain = (ideal / SYNC_INTERVAL_US + 1) * SYNC_INTERVAL_US + radioDelay();
+      onArrival.add(plain - ideal);
+      note++;
+    }
+
+    for (size_t i = 0; i < writes.size(); i++)
+    {
+      runUntil(writes[i].arrival);
+      rxCharacteristic.write(writes[i].data, writes[i].length);
+    }
+  }
+  runUntil(VirtualClock::now() + SYNC_LEAD_US * 2);
+
+  for (size_t i = 0; i < applied.size() && i < ideals.size(); i++)
+    timed.add(applied[i] - ideals[i]);
+
+  Serial.printf("%d notes over %.0f s, %d us connection interval, app clock %+d ppm\n", SYNC_NOTES,
+                VirtualClock::now() / 1e6, SYNC_INTERVAL_US, SYNC_DRIFT_PPM);
+  onArrival.print("applied on arrival");
+  timed.print("timed (OP_At)");
+  residuals.print("device residual");
+  Serial.printf("  %lu late commands\n", (unsigned long)sequencer.lateCommands());
+
+  // the true error, sync included
+  int64_t spread = timed.percentile(99) - timed.percentile(1);
+  int64_t bias = timed.percentile(50);
+  Serial.printf("  timed spread %lld us (p1 to p99), bias %lld us\n", (long long)spread, (long long)bias);
+  bool ok = sequencer.lateCommands() == 0 && timed.count() == SYNC_NOTES && spread <= SYNC_MAX_SPREAD_US &&
+            bias <= SYNC_MAX_BIAS_US && bias >= -SYNC_MAX_BIAS_US;
+  Serial.println(ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
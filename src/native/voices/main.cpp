@@ -0,0 +1,332 @@
+/*
+   Voice mixer check (pio run -e native_voices && .pio/build/native_voices/program [wav] [ima.wav])
+
+   Checks VoiceMixer on a 16-bit PCM sample (default data/viola.wav), in
+   every interpolation mode:
+   - one voice at unity gain and pitch reproduces the sample exactly
+   - an octave up plays every other sample in half the time
+   - samples of a few frames play to their end
+   - more triggers than voices steal the oldest
+   - a full-scale pile-up saturates instead of wrapping around
+   and on an IMA ADPCM sample (default data/viola-ima.wav), which the voices
+   decode as they play: ImaCursor reads what imaDecodeBlock() decodes, in any
+   order, and at several pitches and block sizes the voices play exactly what
+   they play from the decoded sample as PCM.
+   Then repitches a sine by a few intervals and measures the SNR against the
+   exact sine at the same phase, per mode, and times mix() with all voices
+   busy for several block sizes and modes, per frame, from PCM and from ADPCM.
+*/
+
+#include <VoiceMixer.h>
+#include <WavHeader.h>
+#include "../common/Ticks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#define BENCH_FRAMES 32768 // voices are pitched down, so none runs out before this
+#define BENCH_RUNS 10
+#define TONE_RATE 44100
+#define TONE_AMPLITUDE 16000
+#define TONE_LENGTH 16384
+
+bool loadWav(const char *path, std::vector<uint8_t> &bytes, WavFormat &wav)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return false;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    bytes.insert(bytes.end(), buffer, buffer + n);
+  fclose(f);
+  return parseWavHeader(bytes.data(), bytes.size(), wav) && wav.channels == 1 &&
+         wav.dataOffset + wav.dataSize <= bytes.size();
+}
+
+bool loadPcm(const char *path, std::vector<int16_t> &pcm)
+{
+  std::vector<uint8_t> bytes;
+  WavFormat wav;
+  if (!loadWav(path, bytes, wav) || wav.format != WAV_FORMAT_PCM || wav.bitsPerSample != 16)
+    return false;
+  const uint8_t *p = bytes.data() + wav.dataOffset;
+  for (size_t i = 0; i < wav.dataSize / 2; i++)
+    pcm.push_back((int16_t)(p[2 * i] | (p[2 * i + 1] << 8)));
+  return true;
+}
+
+// The blocks as loadSample() keeps them, and all of them decoded
+bool loadAdpcm(const char *path, std::vector<uint8_t> &blocks, uint16_t &blockAlign, std::vector<int16_t> &pcm)
+{
+  std::vector<uint8_t> bytes;
+  WavFormat wav;
+  if (!loadWav(path, bytes, wav) || wav.format != WAV_FORMAT_IMA_ADPCM || wav.blockAlign <= IMA_BLOCK_HEADER)
+    return false;
+  blocks.assign(bytes.begin() + wav.dataOffset, bytes.begin() + wav.dataOffset + wav.dataSize);
+  blockAlign = wav.blockAlign;
+  pcm.resize(imaSampleCount(wav.dataSize, blockAlign));
+  size_t n = 0;
+  for (size_t pos = 0; pos < blocks.size(); pos += blockAlign)
+  {
+    size_t length = blocks.size() - pos < blockAlign ? blocks.size() - pos : blockAlign;
+    n += imaDecodeBlock(&blocks[pos], length, &pcm[n]);
+  }
+  return n == pcm.size();
+}
+
+// Mixes until every voice is done, at most limit frames
+size_t render(VoiceMixer &mixer, std::vector<int16_t> &out, size_t block, size_t limit)
+{
+  int16_t buffer[MIX_BLOCK_MAX];
+  while (mixer.active() > 0 && out.size() < limit)
+  {
+    mixer.mix(buffer, block);
+    out.insert(out.end(), buffer, buffer + block);
+  }
+  return out.size();
+}
+
+bool check(bool condition, const char *what)
+{
+  printf("  %-52s %s\n", what, condition ? "ok" : "FAILED");
+  return condition;
+}
+
+const VoiceMixer::Interpolation modes[] = {VoiceMixer::Nearest, VoiceMixer::Linear, VoiceMixer::Hermite};
+const char *modeNames[] = {"nearest", "linear", "hermite"};
+#define MODE_COUNT 3
+
+// SNR in dB of one voice playing a sine of hz shifted by semitones
+double toneSnr(VoiceMixer::Interpolation mode, double hz, int semitones)
+{
+  std::vector<int16_t> tone(TONE_LENGTH);
+  for (size_t i = 0; i < tone.size(); i++)
+    tone[i] = (int16_t)lrint(TONE_AMPLITUDE * sin(2 * M_PI * hz * i / TONE_RATE));
+  Sample sample = {tone.data(), (uint32_t)tone.size()};
+  VoiceMixer mixer;
+  mixer.setInterpolation(mode);
+  uint32_t increment = VoiceMixer::pitchIncrement(semitones);
+  mixer.trigger(sample, VOICE_UNITY_GAIN, increment);
+  std::vector<int16_t> out;
+  render(mixer, out, 64, tone.size() * 4);
+
+  double signal = 0, noise = 0;
+  // the last frames have no taps past the end
+  for (size_t n = 0; (uint64_t)n * increment < (uint64_t)(TONE_LENGTH - 4) << 16; n++)
+  {
+    double ideal = TONE_AMPLITUDE * sin(2 * M_PI * hz * ((double)n * increment / PITCH_UNITY) / TONE_RATE);
+    signal += ideal * ideal;
+    noise += (out[n] - ideal) * (out[n] - ideal);
+  }
+  return 10 * log10(signal / noise);
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "data/viola.wav";
+  const char *imaPath = argc > 2 ? argv[2] : "data/viola-ima.wav";
+  std::vector<int16_t> pcm;
+  if (!loadPcm(path, pcm))
+  {
+    printf("%s: not a 16-bit mono PCM WAV\n", path);
+    return 1;
+  }
+  std::vector<uint8_t> blocks;
+  uint16_t blockAlign = 0;
+  std::vector<int16_t> decoded;
+  if (!loadAdpcm(imaPath, blocks, blockAlign, decoded))
+  {
+    printf("%s: not a mono IMA ADPCM WAV\n", imaPath);
+    return 1;
+  }
+  Sample sample = {pcm.data(), (uint32_t)pcm.size()};
+  Sample adpcm = {NULL, (uint32_t)decoded.size(), blocks.data(), blockAlign};
+  Sample decodedPcm = {decoded.data(), (uint32_t)decoded.size()};
+  printf("%s: %u samples in RAM, %d voices\n", path, sample.length, VOICE_COUNT);
+  printf("%s: %u samples in %zu bytes of IMA ADPCM\n", imaPath, adpcm.length, blocks.size());
+  bool ok = true;
+
+  for (int m = 0; m < MODE_COUNT; m++)
+  {
+    char what[64];
+    VoiceMixer mixer;
+    mixer.setInterpolation(modes[m]);
+    std::vector<int16_t> out;
+    mixer.trigger(sample, VOICE_UNITY_GAIN, PITCH_UNITY);
+    render(mixer, out, 64, pcm.size() * 2);
+    snprintf(what, sizeof(what), "%s: unity gain and pitch is bit exact", modeNames[m]);
+    ok &= check(out.size() >= pcm.size() && memcmp(out.data(), pcm.data(), pcm.size() * 2) == 0, what);
+
+    out.clear();
+    mixer.trigger(sample, VOICE_UNITY_GAIN, VoiceMixer::pitchIncrement(12));
+    render(mixer, out, 128, pcm.size() * 2);
+    bool same = true;
+    for (size_t i = 0; i < pcm.size() / 2; i++)
+      same &= out[i] == pcm[2 * i];
+    snprintf(what, sizeof(what), "%s: octave up plays every other sample", modeNames[m]);
+    ok &= check(same && out.size() < pcm.size() / 2 + 128, what);
+
+    // a voice must stop after ceil(length / increment) frames, reading nothing past either end
+    bool ends = true;
+    for (uint32_t length = 1; length <= 4; length++)
+    {
+      for (int semitones = -24; semitones <= 24; semitones += 7)
+      {
+        uint32_t increment = VoiceMixer::pitchIncrement(semitones);
+        out.clear();
+        mixer.trigger(Sample{pcm.data() + 1000, length}, VOICE_UNITY_GAIN, increment);
+        while (mixer.active() > 0)
+        {
+          int16_t frame;
+          mixer.mix(&frame, 1);
+          out.push_back(frame);
+        }
+        ends &= out.size() == ((uint64_t)length * PITCH_UNITY + increment - 1) / increment && out[0] == pcm[1000];
+      }
+    }
+    snprintf(what, sizeof(what), "%s: samples of 1 to 4 frames play to the end", modeNames[m]);
+    ok &= check(ends, what);
+  }
+  ok &= check(VoiceMixer::pitchIncrement(-12) == PITCH_UNITY / 2 && VoiceMixer::pitchIncrement(7) == 98193 &&
+                  VoiceMixer::pitchIncrement(-5) == 98193 / 2,
+              "pitch increments");
+
+  {
+    VoiceMixer mixer;
+    uint8_t first = mixer.trigger(sample, VOICE_UNITY_GAIN, PITCH_UNITY);
+    for (int i = 1; i < VOICE_COUNT; i++)
+      mixer.trigger(sample, VOICE_UNITY_GAIN, PITCH_UNITY);
+    uint8_t stolen = mixer.trigger(sample, VOICE_UNITY_GAIN, PITCH_UNITY);
+    mixer.trigger(sample, VOICE_UNITY_GAIN, PITCH_UNITY);
+    ok &= check(mixer.active() == VOICE_COUNT && mixer.stolen() == 2 && stolen == first,
+                "two triggers past the voice count steal the oldest");
+  }
+
+  {
+    std::vector<int16_t> loud(1024, 30000);
+    Sample full = {loud.data(), (uint32_t)loud.size()};
+    VoiceMixer mixer;
+    for (int i = 0; i < VOICE_COUNT; i++)
+      mixer.trigger(full, 65535, PITCH_UNITY);
+    int16_t buffer[MIX_BLOCK_MAX];
+    mixer.mix(buffer, MIX_BLOCK_MAX);
+    bool saturated = true;
+    for (int i = 0; i < MIX_BLOCK_MAX; i++)
+      saturated &= buffer[i] == INT16_MAX;
+    ok &= check(saturated, "eight voices at full scale saturate");
+  }
+
+  {
+    // forward, backward, across blocks and far ahead
+    ImaCursor cursor;
+    cursor.start(blocks.data(), blockAlign);
+    uint32_t at = 0;
+    bool same = true;
+    for (int i = 0; i < 2000; i++)
+    {
+      int16_t out[VOICE_WINDOW];
+      size_t count = 1 + (at * 7) % VOICE_WINDOW;
+      count = count < decoded.size() - at ? count : decoded.size() - at;
+      cursor.read(at, out, count);
+      same &= memcmp(out, &decoded[at], count * 2) == 0;
+      at = (uint32_t)(((uint64_t)at * 1103515245 + 12345 + i) % decoded.size());
+    }
+    ok &= check(same, "ImaCursor reads what imaDecodeBlock() decodes");
+  }
+
+  for (int m = 0; m < MODE_COUNT; m++)
+  {
+    // far down, unity, up and far past the window per frame
+    const int pitches[] = {-24, -5, 0, 7, 12, 31, 70};
+    const size_t sizes[] = {1, 37, 64};
+    bool same = true;
+    for (size_t k = 0; k < sizeof(pitches) / sizeof(pitches[0]); k++)
+    {
+      for (size_t b = 0; b < sizeof(sizes) / sizeof(sizes[0]); b++)
+      {
+        uint32_t increment = VoiceMixer::pitchIncrement(pitches[k]);
+        size_t limit = 150000;
+        std::vector<int16_t> fromAdpcm, fromPcm;
+        VoiceMixer a, p;
+        a.setInterpolation(modes[m]);
+        p.setInterpolation(modes[m]);
+        // a second voice started later, so the two windows move apart
+        a.trigger(adpcm, VOICE_UNITY_GAIN / 2, increment);
+        p.trigger(decodedPcm, VOICE_UNITY_GAIN / 2, increment);
+        render(a, fromAdpcm, sizes[b], 1000);
+        render(p, fromPcm, sizes[b], 1000);
+        a.trigger(adpcm, VOICE_UNITY_GAIN / 2, VoiceMixer::pitchIncrement(pitches[k] + 3));
+        p.trigger(decodedPcm, VOICE_UNITY_GAIN / 2, VoiceMixer::pitchIncrement(pitches[k] + 3));
+        render(a, fromAdpcm, sizes[b], limit);
+        render(p, fromPcm, sizes[b], limit);
+        same &= fromAdpcm == fromPcm;
+      }
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%s: IMA ADPCM voices match the decoded PCM", modeNames[m]);
+    ok &= check(same, what);
+  }
+
+  // a tone in the viola's range and one near the top, a fifth down, a fourth and an octave and a half up
+  const double tones[] = {440, 5000};
+  const int shifts[] = {-7, 5, 18};
+  printf("  SNR in dB of a repitched sine:\n");
+  printf("    %-18s %9s %9s %9s\n", "", modeNames[0], modeNames[1], modeNames[2]);
+  bool ordered = true;
+  for (size_t t = 0; t < sizeof(tones) / sizeof(tones[0]); t++)
+  {
+    for (size_t k = 0; k < sizeof(shifts) / sizeof(shifts[0]); k++)
+    {
+      double snr[MODE_COUNT];
+      for (int m = 0; m < MODE_COUNT; m++)
+        snr[m] = toneSnr(modes[m], tones[t], shifts[k]);
+      ordered &= snr[0] < snr[1] && snr[1] < snr[2];
+      printf("    %5.0f Hz %+3d st   %9.1f %9.1f %9.1f\n", tones[t], shifts[k], snr[0], snr[1], snr[2]);
+    }
+  }
+  ok &= check(ordered, "every repitched tone: nearest < linear < hermite");
+
+  printf("  %s per output frame, %d voices busy (best of %d):\n", TICKS_UNIT, VOICE_COUNT, BENCH_RUNS);
+  printf("    %-16s %9s %9s %9s\n", "", modeNames[0], modeNames[1], modeNames[2]);
+  const size_t sizes[] = {1, 16, 64, 128};
+#define SIZE_COUNT 4
+  int64_t checksum = 0;
+  for (size_t r = 0; r < 2 * SIZE_COUNT; r++)
+  {
+    // PCM rows first, then the same from IMA ADPCM
+    const Sample &benched = r < SIZE_COUNT ? sample : adpcm;
+    size_t size = sizes[r % SIZE_COUNT];
+    printf("    %-5s block %3zu", r < SIZE_COUNT ? "PCM" : "ADPCM", size);
+    for (int m = 0; m < MODE_COUNT; m++)
+    {
+      double best = 1e30;
+      for (int run = 0; run < BENCH_RUNS; run++)
+      {
+        VoiceMixer mixer;
+        mixer.setInterpolation(modes[m]);
+        // detuned so no two voices read the same samples
+        for (int i = 0; i < VOICE_COUNT; i++)
+          mixer.trigger(benched, VOICE_UNITY_GAIN / 4, VoiceMixer::pitchIncrement(-i));
+        int16_t buffer[MIX_BLOCK_MAX];
+        uint64_t start = ticks();
+        for (size_t done = 0; done < BENCH_FRAMES; done += size)
+        {
+          mixer.mix(buffer, size);
+          checksum += buffer[0];
+        }
+        double perFrame = (double)(ticks() - start) / BENCH_FRAMES;
+        if (perFrame < best)
+          best = perFrame;
+      }
+      printf(" %9.2f", best);
+    }
+    printf("\n");
+  }
+  printf("    (checksum %lld)\n", (long long)checksum);
+
+  printf(ok ? "OK\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}